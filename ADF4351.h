@@ -6,645 +6,1170 @@ Analog Device's ADF4351 Library
 
   Define this based on hardware wiring
 */
-#define REF_XTAL 25e6
+#define REF_XTAL 25000000       // Hz
 #define LE_PIN 3
 #define LD_PIN 4
+#define ADF_RCOUNTER 20         // reference path: fPFD = REF_XTAL * 2 / 20
+#define ADF_DOUBLER 1
+#define ADF_DIVIDER 0
+#define ADF_CHIP ChipIDT8V97051 // or ChipADF4351
+#define ADF_CHIPS_MAX 4         // on one SPI bus, an LE pin each
 /*
+  and this on the loop filter, for fast settle mode
+*/
+#define ADF_FASTLOCK_US   40          // wide bandwidth time after a big jump
+#define ADF_FASTLOCK_JUMP 10000000    // VCO Hz, bigger jumps use fast lock
+/*
+
+  Fast Settle
+  -----------
+  Off by default. When on:
+  - The band select clock runs at up to 500 kHz instead of 125 kHz, so
+    the VCO band selection after every R0 write takes a fourth.
+  - A jump over ADF_FASTLOCK_JUMP at the VCO, or into another RF divider,
+    turns on the fast lock timer: for ADF_FASTLOCK_US after R0 the charge
+    pump runs at full current and SW shorts the loop filter damping
+    resistor. Small steps keep the normal loop, with no switching kick.
+  - Cycle slip reduction is enabled if the hardware allows it: 50% duty
+    PFD (RDIV2 on) and charge pump current at its minimum setting.
+
+  Compile time specialization
+  ---------------------------
+  The driver is the ADF435x<RefHz, RCounter, Doubler, Divider, Chip>
+  template, and ADF4351 is the one above. The reference path is fixed, so
+  the PFD frequency and band select dividers are constants, and
+  the planner (PLLPlanFreqK<> in sPLAN.h) gets its factors folded in. Only
+  the measured reference error, REFin_Err, is left for run time; the
+  dividers are worked out on the nominal REFin, a few ppm off at most.
+
+  Plan optimizer
+  --------------
+  Off by default. When on, every frequency gets its own reference path:
+  PLLPlanBest() in sPLAN.h searches the R counter, the doubler and the
+  prescaler for the smallest error at the highest PFD. The RDIV2 divider
+  stays as set in the template. Band select dividers are then worked out
+  at run time for that PFD. Fixed MOD plans, as hop
+  channels use, keep the template's reference path.
+
+  Chip is a traits class, ChipADF4351 or ChipIDT8V97051: the 8V97051
+  R6/R7 registers and readback are only built in for the latter.
+
+  LE and LD pins are constructor arguments, so several chips on the bus
+  are the same type. LE is toggled straight on its port on SAMD21.
+
+  Several chips
+  -------------
+  Clock and data are shared, LE is not. Every chip shifts in every word,
+  but only the one whose LE rises latches it, so chips are written one
+  word at a time as usual. To retune them together, PrepareFreq() each
+  one and then SendAll(): R5-R1 of all chips go out back to back, and R0,
+  the word that retunes, last. Chips taking the same R0 word get it in a
+  single shift with all their LEs rising at once, on the same port write
+  on SAMD21 when they share a port; different R0 words follow each other
+  one word time, about 4 us, apart. Each chip has its own lock stats.
+  A word goes out with interrupts off, LE low to LE high, so a sweep or
+  hop interrupt writing one chip never lands inside a word to another.
 
   Frequency Limit
   ---------------
   While ADF limit is 4,4 GHz, this value in Hertz exceeds a 32-bit value range.
-  On 32-bit compilers, some 64-bit operations can be made, but this limits
-  frequency to 4,2949 GHz over 8 or 16-bit uC.
-
-  If frequency is computed in kHz (a tolerable limitation
-  for a simple instrument), this limit will rise to 4,29 THz.
+  Frequency is handled as uint64_t Hz, and planned with integer math only
+  (see sPLAN.h), so the whole 35 MHz - 4,4 GHz range is covered exactly.
 	
 \*------------------------------------------------------------------------------*/
+#ifndef _ADF4351_H
+#define _ADF4351_H
 
 #include<SPI.h>
 #include "sMATH.h"
+#include "sPLAN.h"
+#include "sCACHE.h"
+#include "sTRACE.h"
+
+// Register map ------------------------------------------------------------
+// Every field of every register: register, lowest bit, width and value at
+// Init(). The chip state is only the packed words; fields are read and
+// written in place with the masks below, and folded to constants when the
+// field is known at compile time.
+struct AdfField
+{
+  uint8_t     Reg;
+  uint8_t     Shift;
+  uint8_t     Width;
+  uint16_t    Reset;
+  const char *Name;       // decoding is host side: trace.py reads this table
+};
 
-#define DEBUG
+enum AdfFieldId
+{
+  ADF_FRAC, ADF_INT,
+  ADF_MOD, ADF_PHASE, ADF_PRESCALER, ADF_PHASE_ADJ,
+  ADF_CNT_RESET, ADF_CP_3STATE, ADF_PD, ADF_PD_POL, ADF_LDP, ADF_LDF,
+  ADF_CP_CURRENT, ADF_DBUF, ADF_R_COUNTER, ADF_RDIV2, ADF_REF_X2,
+  ADF_MUXOUT, ADF_NOISE,
+  ADF_CLK_DIV, ADF_CLK_DIV_MODE, ADF_CSR, ADF_CHG_CANCEL, ADF_ABP,
+  ADF_BSC_MODE,
+  ADF_OUT_PWR, ADF_RF_EN, ADF_AUX_PWR, ADF_AUX_EN, ADF_AUX_SEL, ADF_MTLD,
+  ADF_VCO_PD, ADF_BS_DIV, ADF_RF_DIV, ADF_FB_SEL,
+  ADF_R5_RES, ADF_LD_MODE,
+  // 8V97051 only
+  ADF_EXT_BS_DIV, ADF_BS_AC, ADF_SDM_TYPE, ADF_DITHER_SHAPE, ADF_DITHER_G,
+  ADF_SDM_ORDER, ADF_RFA_HI_PWR, ADF_RFB_HI_PWR, ADF_LDP_EXT, ADF_BS_DO,
+  ADF_DIG_LOCK,
+  ADF_RD_WN, ADF_RD_ADDR, ADF_SCLKE, ADF_EXT_FDIV, ADF_EXT_MOD,
+  ADF_EXT_PHASE, ADF_SEL_16B, ADF_DEV_ID, ADF_REV_ID, ADF_SPI_ERR,
+  ADF_LOSS_ALOCK, ADF_LOSS_DLOCK,
+  ADF_FIELDS
+};
 
-class ADF4351
+constexpr AdfField adfFields[ADF_FIELDS] =
 {
+  {0,  3, 12,    0, "FRAC"},
+  {0, 15, 16, 1600, "INT"},               // 1 GHz
+
+  {1,  3, 12,    2, "MOD"},
+  {1, 15, 12,    1, "PHASE"},             // 1 - not used
+  {1, 27,  1,    1, "PRESCALER"},         // 0 - 4/5 (up to 3.6 GHz), 1 - 8/9
+  {1, 28,  1,    0, "PHASE_ADJ"},
+
+  {2,  3,  1,    0, "CNT_RESET"},
+  {2,  4,  1,    0, "CP_3STATE"},
+  {2,  5,  1,    0, "PD"},
+  {2,  6,  1,    1, "PD_POL"},            // 1 - passive loop filter
+  {2,  7,  1,    0, "LDP"},
+  {2,  8,  1,    0, "LDF"},
+  {2,  9,  4,   15, "CP_CURRENT"},        // depends on loop filter design
+  {2, 13,  1,    0, "DBUF"},
+  {2, 14, 10,    0, "R_COUNTER"},         // reference path: template
+  {2, 24,  1,    0, "RDIV2"},
+  {2, 25,  1,    0, "REF_X2"},
+  {2, 26,  3,    0, "MUXOUT"},            // chip traits
+  {2, 29,  2,    0, "NOISE"},             // 0 - low noise, 3 - low spur
+
+  {3,  3, 12,    0, "CLK_DIV"},           // fast lock timer, see SettleMode
+  {3, 15,  2,    0, "CLK_DIV_MODE"},
+  {3, 18,  1,    0, "CSR"},
+  {3, 21,  1,    0, "CHG_CANCEL"},
+  {3, 22,  1,    0, "ABP"},
+  {3, 23,  1,    1, "BSC_MODE"},
+
+  {4,  3,  2,    0, "OUT_PWR"},           // -4 dBm
+  {4,  5,  1,    0, "RF_EN"},
+  {4,  6,  2,    0, "AUX_PWR"},           // RFoutB not wired on board
+  {4,  8,  1,    0, "AUX_EN"},
+  {4,  9,  1,    0, "AUX_SEL"},
+  {4, 10,  1,    1, "MTLD"},              // mute till lock detect
+  {4, 11,  1,    0, "VCO_PD"},
+  {4, 12,  8,   25, "BS_DIV"},
+  {4, 20,  3,    2, "RF_DIV"},            // 1 GHz
+  {4, 23,  1,    1, "FB_SEL"},            // 1 - feedback from VCO
+
+  {5, 19,  2,    3, "R5_RES"},            // reserved, set
+  {5, 22,  2,    1, "LD_MODE"},           // digital lock detect
+
+  {6,  3,  4,    0, "EXT_BS_DIV"},
+  {6, 16,  2,    0, "BS_AC"},
+  {6, 18,  2,    0, "SDM_TYPE"},
+  {6, 20,  1,    0, "DITHER_SHAPE"},
+  {6, 21,  1,    0, "DITHER_G"},
+  {6, 22,  2,    0, "SDM_ORDER"},
+  {6, 24,  1,    0, "RFA_HI_PWR"},
+  {6, 25,  1,    0, "RFB_HI_PWR"},
+  {6, 26,  2,    0, "LDP_EXT"},
+  {6, 30,  1,    0, "BS_DO"},
+  {6, 31,  1,    0, "DIG_LOCK"},
+
+  {7,  3,  1,    0, "RD_WN"},
+  {7,  4,  3,    0, "RD_ADDR"},
+  {7,  7,  1,    0, "SCLKE"},
+  {7,  8,  4,    0, "EXT_FDIV"},
+  {7, 12,  4,    0, "EXT_MOD"},
+  {7, 16,  4,    0, "EXT_PHASE"},
+  {7, 20,  1,    0, "SEL_16B"},
+  {7, 21,  4,    0, "DEV_ID"},
+  {7, 25,  3,    0, "REV_ID"},
+  {7, 29,  1,    0, "SPI_ERR"},
+  {7, 30,  1,    0, "LOSS_ALOCK"},
+  {7, 31,  1,    0, "LOSS_DLOCK"},
+};
+
+// Bits of field f in its register word
+constexpr uint32_t adfMask(uint8_t f)
+{
+  return (uint32_t)((1ull<<adfFields[f].Width)-1) << adfFields[f].Shift;
+}
+
+// Field f out of a word of its register
+constexpr uint32_t adfGet(uint32_t word, uint8_t f)
+{
+  return (word & adfMask(f)) >> adfFields[f].Shift;
+}
+
+// Word with field f set to v
+constexpr uint32_t adfPut(uint32_t word, uint8_t f, uint32_t v)
+{
+  return (word & ~adfMask(f)) | ((v << adfFields[f].Shift) & adfMask(f));
+}
+
+// Register word at Init(): control bits and every field's reset value
+constexpr uint32_t adfResetWord(uint8_t reg, uint8_t f = 0)
+{
+  return f==ADF_FIELDS ? reg :
+    (adfFields[f].Reg==reg ? (uint32_t)adfFields[f].Reset << adfFields[f].Shift : 0) |
+    adfResetWord(reg, f+1);
+}
+
+// Register bits owned by the frequency plan: INT/FRAC, MOD, prescaler,
+// reference path, LDF/LDP, ABP/charge cancelation, RF divider and band
+// select divider
+const uint32_t adfPlanMask[5] =
+{
+  adfMask(ADF_INT) | adfMask(ADF_FRAC),
+  adfMask(ADF_MOD) | adfMask(ADF_PRESCALER),
+  adfMask(ADF_LDF) | adfMask(ADF_LDP) |
+    adfMask(ADF_R_COUNTER) | adfMask(ADF_REF_X2) | adfMask(ADF_RDIV2),
+  adfMask(ADF_ABP) | adfMask(ADF_CHG_CANCEL),
+  adfMask(ADF_RF_DIV) | adfMask(ADF_BS_DIV)
+};
+
+// R0 latch to LD rising, per RF divider band
+struct LockStat
+{
+  uint32_t Count;
+  uint32_t Sum_us;
+  uint32_t Min_us;
+  uint32_t Max_us;
+};
+
+// Chip variants
+struct ChipADF4351
+{
+  static const uint8_t Registers = 6;
+  static const uint8_t MuxOut = 0;        // three-state
+};
+
+struct ChipIDT8V97051
+{
+  static const uint8_t Registers = 8;     // R6 and R7 for readback
+  static const uint8_t MuxOut = 7;        // SDO
+};
+
+// Band select clock divider, for a clock of at most bsc Hz
+constexpr uint8_t adfBandSelDiv(uint32_t fPFD, uint32_t bsc, uint32_t max)
+{
+  return (fPFD+bsc-1)/bsc > max ? max : ((fPFD+bsc-1)/bsc ? (fPFD+bsc-1)/bsc : 1);
+}
+
+// Fast lock timer, 12 bits. The chip times CLK_DIV*MOD PFD cycles, so it
+// follows MOD and is worked out for every plan
+inline uint16_t adfFastLockTimer(uint32_t fPFD, uint16_t mod, uint32_t us)
+{
+uint64_t n;
+
+  n = (uint64_t)mod*1000000;
+  n = ((uint64_t)fPFD*us + n-1)/n;
+  return n>4095 ? 4095 : (n ? n : 1);
+}
+
+#define ADF_TEMPLATE template<uint32_t RefHz, uint16_t RCounter, bool Doubler, bool Divider, class Chip>
+#define ADF_CLASS ADF435x<RefHz,RCounter,Doubler,Divider,Chip>
+
+ADF_TEMPLATE
+class ADF435x
+{
+	friend class sBENCH;
+
+	static_assert(RCounter>=1 && RCounter<=1023, "R counter is 10 bits");
+	static_assert((uint64_t)RefHz*2 < 0x80000000UL, "fREF * 2 has to fit in 31 bits");
+
 	public:
+		// Reference path, as programmed in R2
+		static const uint32_t RK = RCounter * (Divider ? 2 : 1);
+		static const uint32_t DK = Doubler ? 2 : 1;
+		static const uint32_t PFDHz = RefHz * DK / RK;    // nominal
+
+		// With a plan cache, or 0 to plan every frequency (8 KB less RAM)
+		ADF435x(uint8_t lePin = LE_PIN, uint8_t ldPin = LD_PIN, sCACHE* cache = 0);
+
 		// Initialize
 		void Init();
+		// Register state back to defaults, nothing sent. Enough on its own
+		// for MakeREGS() with no chip, as the host plan compiler does
+		void Reset();
 		
-		// Set the output frequency
-		int SetFreq(double freq);
+		// Set the output frequency, in Hz
+		int SetFreq(uint64_t freq);
+		// Same, but only into the register state: SendAll() or the next
+		// write puts it on the chip
+		int PrepareFreq(uint64_t freq);
+		// Send what changed on n chips, their R0 last and latched together
+		static void SendAll(ADF435x **chip, uint8_t n);
     
 		// Enable or disable RF output. 0 = disable, 1 = enable
 		void SetOut(uint8_t enabled);
 		
-		// Set the RF output power
-		void SetPower(uint8_t power);
+		// Set the RF output power, in cdBm: the nearest of -4, -1, +2, +5 dBm
+		void SetPower(int16_t power);
+
+		// Fast settle mode, see above. Takes effect on the next SetFreq
+		void SetFastSettle(bool on);
+		bool FastSettle;
+		// Plan optimizer, see above. Takes effect on the next SetFreq
+		void SetOptimize(bool on);
+		bool Optimize;
+		// Reference path in the registers, as the last plan left it
+		void PlanRef(PLLRef *ref);
+		// PFD of the template's reference path, Hz, REFin_Err included
+		uint32_t RefPFD(void);
 
 		// Get frequency lock state
 		bool FreqLocked();
-    
+		// An R0 went out and LD hasn't risen since
+		bool Settling();
+
     void GetREGS(uint32_t* reg);
-    void PutREGS(uint32_t* reg);
+    // Take R0-R5 as they are, planned for freq: Plan is read back from
+    // them, its error against freq (none when 0)
+    void PutREGS(uint32_t* reg, uint64_t freq=0);
+    // Take one raw register word, R0-R5 by its control bits
+    int SetREG(uint32_t word);
+
+    // Compute R0-R4 for freq without touching the chip or current state,
+    // on a fixed MOD when mod is not 0. The plan goes to plan if not 0
+    int MakeREGS(uint64_t freq, uint32_t* reg, uint16_t mod=0, PLLPlan* plan=0);
+    // Send precomputed R0-R4, only changed words. No debug output, ISR safe
+    void LoadREGS(const uint32_t* reg);
+    // Send a precomputed R0 alone, R1-R4 already on the chip. ISR safe
+    void LoadR0(uint32_t r0);
 		
-		uint32_t REFin;			// Reference oscillator frequency
-		int32_t REFin_Err;   // Reference frequency error
+		int32_t REFin_Err;   // Reference frequency error, Hz off RefHz
+
+    PLLPlan Plan;        // Last computed frequency plan (actual freq & error)
+
+    uint32_t WordsWritten;  // register words actually sent over SPI
+    uint32_t WordsSkipped;  // register words not sent, already on the chip
+
+    sCACHE *Cache;          // plans already computed, by frequency, 0 none
+
+    // Lock detect, from the LD pin interrupt
+    LockStat LockTime[7];   // by RF divider, 2^n
+    uint32_t Unlocks;       // LD falls with no retune going on
+    void ClearLockStats(void);
+    // Copy out the stats, consistent with the interrupt
+    void GetLockStats(LockStat* stat, uint32_t* unlocks);
+    // LD pin edge, called from the interrupt
+    void LockEdge(void);
+    // Told of every R0 sent and LD edge, from the interrupts too: for
+    // status kept by events. 0 for none
+    enum { LOCK_R0, LOCK_RISE, LOCK_FALL };
+    static void (*LockHook)(ADF435x* chip, uint8_t event);
 			
 	private:
+		static const uint8_t BandSelDiv = adfBandSelDiv(PFDHz, 125000, 255);
+		static const uint8_t BandSelDivFast = adfBandSelDiv(PFDHz, 500000, 254);
+
+		uint8_t LePin;
+		uint8_t LdPin;
+#if defined(ARDUINO_ARCH_SAMD)
+		volatile uint32_t *LeSet;     // LE port OUTSET/OUTCLR and bit
+		volatile uint32_t *LeClr;
+		uint32_t LeBit;
+#endif
+		void LeLow(void);
+		void LeHigh(void);
 
-		struct Register0
-		{
-      uint8_t   _n                  : 3;
-			uint16_t  Fractional          : 12;
-			uint16_t  Integer             : 16;
-      bool      res0                : 1;
-		};
-		
-		struct Register1
-		{
-      uint8_t   _n                  : 3;
-			uint16_t  Modulus             : 12;
-			uint16_t  PhaseVal            : 12;
-			bool      Prescaler           : 1;
-			bool      PhaseAdjust         : 1;
-      uint8_t   res0                : 3;
-		};
-		
-		struct Register2
-		{
-      uint8_t   _n                  : 3;
-			bool      CounterReset        : 1;
-			bool      CPTri               : 1;
-			bool      PowerDown           : 1;
-			bool      PDPolarity          : 1;
-			bool      LDP                 : 1;
-			bool      LDF                 : 1;
-			uint8_t   ChargePumpCurrent   : 4;
-			bool      DoubleBuffer        : 1;
-			uint16_t  RCounter            : 10;
-			bool      RefDivider          : 1;
-			bool      RefDoubler          : 1;
-			uint8_t   MUXOut              : 3;
-			uint8_t   NoiseMode           : 2;
-      bool      res0                : 1;
-		};
-		
-		struct Register3
-		{
-      uint8_t   _n                  : 3;
-			uint16_t  ClockDivider        : 12;
-			uint8_t   ClockDividerMode    : 2;
-      bool      res0                : 1;
-			bool      CSR                 : 1;
-      uint8_t   res1                : 2;
-			uint8_t   ChargeCancelation   : 1;
-			bool      ABP                 : 1;
-			bool      BandSelectClockMode : 1;
-      uint8_t   res2                : 8;
-		};
-		
-		struct Register4
-		{
-      uint8_t   _n                  : 3;
-			uint8_t   OutputPower         : 2;
-			bool      RFOutputEnabled     : 1;
-			uint8_t   AuxOutputPower      : 2;
-			bool      AuxOutputEnabled    : 1;
-			bool      AuxOutputSelect     : 1;
-			bool      MTLD                : 1;
-			bool      VCOPoweredDown      : 1;
-			uint8_t   BandSelectDivider   : 8;
-			uint8_t   RFDivider           : 3;
-			bool      FBSelect            : 1;
-      uint8_t   res0                : 8;
-		};
-		
-		struct Register5
-		{
-      uint8_t   _n                  : 3;
-      uint16_t  res0                : 16;
-      uint8_t   res1                : 2;
-      bool      res2                : 1;
-      uint8_t   LDPinMode           : 2;
-      uint8_t   res3                : 8;
-		};
-
-		struct Register6          // 8V97051
-		{
-      uint8_t   _n                  : 3;
-      uint8_t   ExtBndSelDiv        : 4;
-      bool      res0                : 1;
-      uint8_t   res1                : 8;
-      uint8_t   band_select_ac      : 2;
-      uint8_t   SDMType             : 2;
-      bool      ShapeDitherEn       : 1;
-      bool      DitherG             : 1;
-      uint8_t   SDMOrder            : 2;
-      bool      rfouta_hi_pwr       : 1;
-      bool      rfoutb_hi_pwr       : 1;
-      uint8_t   LDP_Ext             : 2;
-      bool      res2                : 1;
-      bool      res3                : 1;
-      bool      Band_select_do      : 1;
-      bool      DigLock             : 1;
-		};
-
-		struct Register7          // 8V97051 only
-		{
-      uint8_t   _n                  : 3;
-      bool      SPI_R_WN            : 1;
-      uint8_t   Rd_Addr             : 3;
-      bool      sclke               : 1;
-      uint8_t   ext_fdiv            : 4;
-      uint8_t   ext_mod             : 4;
-      uint8_t   ext_phase           : 4;
-      bool      sel_16b_12b         : 1;
-      uint8_t   Dev_ID              : 4;
-      uint8_t   Rev_ID              : 3;
-      bool      res0                : 1;
-      bool      Spi_error           : 1;
-      bool      Loss_Anlg_Lock      : 1;
-      bool      Loss_Dig_Lock       : 1;      
-		};
-		
+		// LD pin interrupt, shared: each chip looks at its own pin
+		static ADF435x *Chips[ADF_CHIPS_MAX];
+		static uint8_t ChipCount;
+		static void LockISR(void);
+		uint8_t LdLevel;        // LD as last seen by LockEdge()
 
-  
-    struct Register0 R0;
-    struct Register1 R1;
-    struct Register2 R2;
-    struct Register3 R3;
-    struct Register4 R4;
-    struct Register5 R5;
-    struct Register6 R6;
-    struct Register7 R7;
+    uint32_t REG[Chip::Registers];    // the chip state, packed
+    uint32_t SentREG[6];    // last word written for each register
+    uint8_t  SentValid;     // bit n set when SentREG[n] is known
+
+    uint64_t LastVCO;       // Hz, of the last SetFreq, 0 to force fast lock
 
-    uint32_t REG[8];
+    uint32_t LatchedAt_us;  // last R0 write
+    uint8_t  LatchedBand;   // RF divider it set
+    volatile bool LockPending; // waiting for LD to rise after it
 
-  //uint32_t REG[8]={(uint32_t)&R0,(uint32_t)&R1,(uint32_t)&R2,(uint32_t)&R3,(uint32_t)&R4,(uint32_t)&R5};
+    // Field f of the register state, see adfFields
+    uint32_t Get(uint8_t f);
+    void Set(uint8_t f, uint32_t v);
+    // Reference path bits back to the template's
+    void FixRef(void);
+    // Plan INT/FRAC/MOD/RF divider and reference path from the registers
+    void ReadPlan(PLLRef *ref);
 
-		// Build the register to the REG[] array
-		void BuildREG(uint8_t num);
 		// Write the REG[] array onto the device
 		void WriteREG(uint32_t val);
 
-    // build all standard registers
-    void BuildAllREG(void);
-		// Write all standard registers
+		// Write the standard registers that changed, R0 last
 		void WriteAllREG(void);
+    // Registers whose REG[] differs from the chip, plus R0 when it must latch
+    uint8_t DirtyMask(void);
+    // Shift out the REG[] words in mask, R5 first and R0 last
+    void SendREG(uint8_t mask);
+    // Bookkeeping around sending the words in mask: lock timing, words
+    // known to be on the chip
+    void SendStart(uint8_t mask);
+    void SendDone(uint8_t mask);
+    // Clock one word into the device, no debug output
+    void ShiftREG(uint32_t val);
+
+    // Plan freq into the register fields, on a fixed MOD when mod is not 0
+    int ApplyFreq(uint64_t freq, uint16_t mod=0);
+    // Fast lock timer and CSR for a retune to the current plan
+    void SettleMode(uint64_t fVCO);
+    // Reference path as currently programmed
+    void GetRef(PLLRef *ref);
 
     uint32_t ReadREG(uint32_t val);
 		
 };
 
+ADF_TEMPLATE
+ADF_CLASS *ADF_CLASS::Chips[ADF_CHIPS_MAX];
+ADF_TEMPLATE
+uint8_t ADF_CLASS::ChipCount = 0;
+ADF_TEMPLATE
+void (*ADF_CLASS::LockHook)(ADF_CLASS* chip, uint8_t event) = 0;
+
+ADF_TEMPLATE
+ADF_CLASS::ADF435x(uint8_t lePin, uint8_t ldPin, sCACHE* cache)
+{
+  LePin = lePin;
+  LdPin = ldPin;
+  Cache = cache;
+}
+
 /* Public Functions =============================================================*/
-void ADF4351::Init()
+ADF_TEMPLATE
+void ADF_CLASS::Init()
 {
+int c;
+
+	pinMode(LePin, OUTPUT);
+	pinMode(LdPin, INPUT); // INPUT_PULLUP ?
+#if defined(ARDUINO_ARCH_SAMD)
+  LeSet = &PORT->Group[g_APinDescription[LePin].ulPort].OUTSET.reg;
+  LeClr = &PORT->Group[g_APinDescription[LePin].ulPort].OUTCLR.reg;
+  LeBit = 1ul << g_APinDescription[LePin].ulPin;
+#endif
 
-	pinMode(LE_PIN, OUTPUT);
-	pinMode(LD_PIN, INPUT); // INPUT_PULLUP ?
+  ClearLockStats();
+  LockPending = 0;
+  LdLevel = digitalRead(LdPin);
+  for(c=0;c<ChipCount && Chips[c]!=this;c++)
+    ;
+  if(c==ChipCount && ChipCount<ADF_CHIPS_MAX)
+    Chips[ChipCount++] = this;
+  attachInterrupt(digitalPinToInterrupt(LdPin), LockISR, CHANGE);
 	
 	SPI.begin();
 	SPI.setDataMode(SPI_MODE0);
 	SPI.setBitOrder(MSBFIRST);
 	SPI.setClockDivider(SPI_CLOCK_DIV2);	// 16 MHz system clock /2 = 8MHz SPI clock
   
-	// Set register 0 default values
-  R0._n = 0;
-	R0.Integer = 1600;                     // DEFAULT: for 1GHz
-	R0.Fractional = 0;                    // DEFAULT: for 1GHz
-  R0.res0 = 0;
-
-	// Set register 1 default values
-  R1._n = 1;
-	R1.PhaseAdjust = 0;
-	R1.Prescaler = 1;         // 0 - 4/5(limits to 3.6GHz)    1 - 8/9
-	R1.PhaseVal = 1;          // 1 - not used      
-	R1.Modulus = 2;                      // DEFAULT: for 1GHz
-  R1.res0 = 0;
-	
-	// Set register 2 default values
-  R2._n = 2;
-	R2.NoiseMode = 0;         // 0 - Minimize Phase Noise mode // 3 - Minimize Spur mode
-	R2.MUXOut = 7;            // 0 - Tri-State // 7 - Enable SDO (for 8V97051)
-	R2.RefDoubler = 1;        // it is said this improves noise performance  
-	R2.RefDivider = 0;
-	R2.RCounter = 20;					// Divide REFin by 20
-	R2.DoubleBuffer = 0;
-	R2.ChargePumpCurrent = 15; // 7 - depends on loop filter design
-	R2.LDF = 0;
-	R2.LDP = 0;
-	R2.PDPolarity = 1;        // 1 - for passive loop filter
-	R2.PowerDown = 0;
-	R2.CPTri = 0;             // 0 - normal operation
-	R2.CounterReset = 0;      // 0 - normal operation
-	R2.res0 = 0;
-
-  // Set register 3 default values
-  R3._n = 3;
-	R3.ClockDivider = 0;      //150???????????????????
-	R3.ClockDividerMode = 0;
-	R3.CSR = 0;
-	R3.ChargeCancelation = 0;
-	R3.ABP = 0;
-	R3.BandSelectClockMode = 1;
-  R3.res0 = 0;
-  R3.res1 = 0;
-  R3.res2 = 0;
-
-	// Set register 4 default values
-  R4._n = 4;
-	R4.FBSelect = 1;             // 1 - feedback from VCO
-	R4.RFDivider = 2;            // DEFAULT: for 1GHz
-	R4.BandSelectDivider = 25;
-	R4.VCOPoweredDown = 0;
-	R4.MTLD = 1;                 // mute till LD
-	R4.AuxOutputSelect = 0;      // RFoutB not wired on board
-	R4.AuxOutputEnabled = 0;     // RFoutB not wired on board
-	R4.AuxOutputPower = 0;       // RFoutB not wired on board
-	R4.RFOutputEnabled = 0;
-	R4.OutputPower = 0;          // min power (supposed -4 dBm)
-  R4.res0 = 0;
-
-  // Set register 5 default values;
-  R5._n = 5;
-  R5.LDPinMode = 1;            // digital lock detect
-  R5.res0 = 0;
-  R5.res1 = 3;
-  R5.res2 = 0;
-  R5.res3 = 0;
-
-  // registers 6 and 7 don't need initialization
-
-	REFin = REF_XTAL;
-  REFin_Err = 0;
-	
-	BuildAllREG();
+  Reset();
   WriteAllREG();
 }
 
+ADF_TEMPLATE
+void ADF_CLASS::Reset()
+{
+int c;
+
+  // every field to its reset value, see adfFields
+  for(c=0;c<Chip::Registers;c++)
+    REG[c] = adfResetWord(c);
+  Set(ADF_MUXOUT, Chip::MuxOut);  // 0 - Tri-State // 7 - Enable SDO (for 8V97051)
+  FixRef();
+
+  FastSettle = 0;
+  Optimize = 0;
+  LastVCO = 0;
+  REFin_Err = 0;
+
+  WordsWritten = 0;
+  WordsSkipped = 0;
+  SentValid = 0;            // chip state unknown: send everything
+}
+
 
-int ADF4351::SetFreq(double freq)
+ADF_TEMPLATE
+int ADF_CLASS::SetFreq(uint64_t freq)
 {
-float fRES;
-double fVCO;
-float N,fPFD;
-float frac,mod;
-int gcd; 
+  if(PrepareFreq(freq))
+    return 1;
 
-  fRES=1000;
-  gcd=-1;
-  
-  // Calculate Phase Frequency Detector frequency
-  fPFD = (REFin+REFin_Err) / (float)R2.RCounter;
-
-	if(R2.RefDoubler==1)
-		fPFD *= 2.0;
-	if(R2.RefDivider==1)
-		fPFD /= 2.0;
-#ifdef DEBUG
-Serial.print("fPFD: ");Serial.println(fPFD);
-#endif
-  R4.BandSelectDivider = fPFD/125e3; // 125 kHz is the limit
-  
-	// Calculate VCO frequency and the correspondent Divider
-	if (freq >= 2200e6)
-  {
-		R4.RFDivider = 0;		// Divide by 1 (VCO fundamental)
-    fVCO = freq * 1;
-  }
-	if (freq < 2200e6)
-  {
-		R4.RFDivider = 1;		// Divide VCO by 2
-    fVCO = freq * 2;
-  }
-	if (freq < 1100e6)
-  {
-		R4.RFDivider = 2;		// Divide VCO by 4
-    fVCO = freq * 4;
-  }
-	if (freq < 550e6)
-  {
-		R4.RFDivider = 3;		// Divide VCO by 8
-    fVCO = freq * 8;
-  }
-	if (freq < 275e6)
-  {
-		R4.RFDivider = 4;		// Divide VCO by 16
-    fVCO = freq * 16;
-  }
-	if (freq < 137500e3)
+  WriteAllREG();
+
+  // R0 back from the chip, for the trace
+  if(TraceOn(TRACE_SPI))
+    ReadREG(0);
+
+  return 0;
+}
+
+ADF_TEMPLATE
+int ADF_CLASS::PrepareFreq(uint64_t freq)
+{
+PLLRef ref;
+uint32_t words[5];
+int32_t err;
+int c;
+
+  GetRef(&ref);
+
+  if(Cache && Cache->Find(freq,&ref,words,&err))
   {
-		R4.RFDivider = 5;		// Divide VCO by 32
-    fVCO = freq * 32;
+    // planned before: take the plan bits, keep power, output, etc.
+    for(c=0;c<5;c++)
+      REG[c] = (words[c] & adfPlanMask[c]) | (REG[c] & ~adfPlanMask[c]);
+    ReadPlan(&ref);
+    Plan.fPFD = PLLRefPFD(&ref);
+    Plan.fOut_mHz = freq*1000 + err;
+    Plan.Err_mHz = err;
+    Trace64(TRACE_PLAN, TR_CACHE_HIT, freq);
   }
-	if (freq < 68750e3)
+  else
   {
-		R4.RFDivider = 6;		// Divide VCO by 64
-    fVCO = freq * 64;
+    if(ApplyFreq(freq))
+      return 1;
+
+    if(Cache)
+      Cache->Store(freq, REG, Plan.Err_mHz);
   }
-#ifdef DEBUG
-Serial.print("RFDiv: ");Serial.println(R4.RFDivider);
-Serial.print("fVCO: ");
-  SerialPrintDouble(fVCO);Serial.print("\r\n");   //Serial.println((uint64_t)fVCO);
-#endif
 
-	// Calculate the PLL integer divider
-  N = fVCO / fPFD;
-	R0.Integer = (uint16_t)N;
-#ifdef DEBUG
-Serial.print("N: ");Serial.println(N);
-#endif
+  SettleMode(freq << Plan.RFDivider);
+  return 0;
+}
 
-	// Calculate MOD & FRAC
-  mod  = fPFD / fRES;
-  frac = mod * ( N - (double)R0.Integer);
+ADF_TEMPLATE
+void ADF_CLASS::SendAll(ADF435x **chip, uint8_t n)
+{
+uint8_t mask[ADF_CHIPS_MAX];
+uint8_t group,sent;
+uint32_t val;
+int i,j,c;
 
-#ifdef DEBUG
-Serial.print("VALUES\r\n\tfrac: ");Serial.print(frac);Serial.print(" / mod: ");Serial.println(mod);
-#endif
+  if(n>ADF_CHIPS_MAX)
+    n = ADF_CHIPS_MAX;
 
-  if(frac==0)
+  for(i=0;i<n;i++)
   {
-    // ---------------------------------- we're in integer-N Mode
-    R0.Fractional=0;
-    R1.Modulus=2;
-    R2.LDF=1;
-    R2.LDP=1;
-    R3.ABP=1;
-    R3.ChargeCancelation=1;
+    mask[i] = chip[i]->DirtyMask();
+    chip[i]->SendStart(mask[i]);
   }
-  else
+
+  // R5-R1, each chip latching its own: nothing retunes before its R0
+  for(c=5;c>0;c--)
+    for(i=0;i<n;i++)
+      if(mask[i] & (1<<c))
+        chip[i]->ShiftREG(chip[i]->REG[c]);
+
+  // R0s, once per distinct word, to every chip that takes it at once
+  sent = 0;
+  for(i=0;i<n;i++)
   {
-    // -------------------------------- we're in fractional-N Mode
-    mod=round(mod);
-    frac=round(frac);
-#ifdef DEBUG
-Serial.print("ROUNDed\r\n\tfrac: ");Serial.print(frac);Serial.print(" / mod: ");Serial.println(mod);
-#endif
-    // simplify FRAC/MOD fraction (mod must be < 4096)
-    gcd=getGCD(frac,mod);
-    if(mod>4095 && gcd==1)
+    if(!(mask[i] & 1) || (sent & (1<<i)))
+      continue;
+
+    noInterrupts();         // the whole word, as ShiftREG()
+    group = 0;
+    for(j=i;j<n;j++)
+      if((mask[j] & 1) && !(sent & (1<<j)) && chip[j]->REG[0]==chip[i]->REG[0])
+      {
+        group |= 1<<j;
+        chip[j]->LeLow();
+      }
+    sent |= group;
+
+    val=__builtin_bswap32(chip[i]->REG[0]);
+    SPI.transfer(&val,4);
+
+#if defined(ARDUINO_ARCH_SAMD)
+    // one OUTSET write per port, so they rise on the same clock
+    for(j=i;j<n;j++)
     {
-#ifdef DEBUG
-Serial.println("*******CAN'T SOLVE!*********");
-#endif
-      return 1;
+      if(!(group & (1<<j)))
+        continue;
+      val = 0;
+      for(c=j;c<n;c++)
+        if((group & (1<<c)) && chip[c]->LeSet==chip[j]->LeSet)
+        {
+          val |= chip[c]->LeBit;
+          group &= ~(1<<c);
+        }
+      *chip[j]->LeSet = val;
     }
-
-    R0.Fractional = frac/gcd;
-    R1.Modulus = mod/gcd;
-    R2.LDF=0;
-    R2.LDP=0;
-    R3.ABP=0;
-    R3.ChargeCancelation=0;
-#ifdef DEBUG
-Serial.print("GCD(");Serial.print(gcd);Serial.print(")\r\n\tfrac: ");Serial.print(R0.Fractional);Serial.print(" / mod: ");Serial.println(R1.Modulus);
+#else
+    for(j=i;j<n;j++)
+      if(group & (1<<j))
+        chip[j]->LeHigh();
 #endif
+    interrupts();
+  }
+
+  for(i=0;i<n;i++)
+    chip[i]->SendDone(mask[i]);
+}
+
+ADF_TEMPLATE
+int ADF_CLASS::MakeREGS(uint64_t freq, uint32_t *reg, uint16_t mod, PLLPlan *plan)
+{
+PLLPlan last=Plan;
+uint32_t save[5];
+int c,err;
 
+  for(c=0;c<5;c++)
+    save[c]=REG[c];
+
+  err=ApplyFreq(freq,mod);
+  for(c=0;c<5;c++)
+  {
+    reg[c]=REG[c];
+    REG[c]=save[c];
   }
 
-#ifdef DEBUG
-Serial.print("INT: ");Serial.println(R0.Integer);
-Serial.print("FRAC: ");Serial.println(R0.Fractional);
-Serial.print("MOD: ");Serial.println(R1.Modulus);
-#endif
-	
-	BuildREG(4);WriteREG(REG[4]);
-	BuildREG(3);WriteREG(REG[3]);
-	BuildREG(2);WriteREG(REG[2]);
-	BuildREG(1);WriteREG(REG[1]);
-	BuildREG(0);WriteREG(REG[0]);
-
-#ifdef DEBUG
-// let's try to read a register...
-Serial.println("Reading R0: ");
-uint32_t rREG = ReadREG(0);
-Serial.println(rREG,HEX);
-#endif
+  if(plan)
+    *plan=Plan;
+  Plan=last;
+  return err;
+}
 
-  return 0;
+ADF_TEMPLATE
+void ADF_CLASS::LoadREGS(const uint32_t *reg)
+{
+int c;
+
+  for(c=0;c<5;c++)
+    REG[c]=reg[c];
+
+  SendREG(DirtyMask());
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::LoadR0(uint32_t r0)
+{
+  REG[0]=r0;
+  SendREG(1);
 }
 
-void ADF4351::SetOut(uint8_t enable)
+
+ADF_TEMPLATE
+void ADF_CLASS::SetOut(uint8_t enable)
 {
 	
   if(enable)
   {
-    //R4.VCOPoweredDown = !enable;
-    R4.RFOutputEnabled = enable;
+    //Set(ADF_VCO_PD, !enable);
+    Set(ADF_RF_EN, enable);
   }
   else
   {
-    R4.RFOutputEnabled = enable;
-    //R4.VCOPoweredDown = !enable; // eliminates RF leakage, but puts LD down
+    Set(ADF_RF_EN, enable);
+    //Set(ADF_VCO_PD, !enable); // eliminates RF leakage, but puts LD down
   }
 
-  BuildREG(4);WriteREG(REG[4]);
+  WriteAllREG();
 }
 
 
-void ADF4351::SetPower(uint8_t power)
+ADF_TEMPLATE
+void ADF_CLASS::SetPower(int16_t power)
 {
 int pwr;
 
-	// Calc reg value
-  pwr=((power+4)/3);
+	// Calc reg value, 3 dB steps from -4 dBm, rounded
+  pwr=power+400;
+  pwr=pwr<0 ? 0 : (pwr+150)/300;
+  if(pwr>3)
+    pwr=3;
 	
-	R4.OutputPower = pwr;
+	Set(ADF_OUT_PWR, pwr);
 
-  BuildREG(4);WriteREG(REG[4]);
+  WriteAllREG();
 }
 
 
-bool ADF4351::FreqLocked()
+ADF_TEMPLATE
+bool ADF_CLASS::Settling()
 {
-  //if(R4.VCOPoweredDown) // VCO Down trick
+  return LockPending;
+}
+
+ADF_TEMPLATE
+bool ADF_CLASS::FreqLocked()
+{
+  //if(Get(ADF_VCO_PD)) // VCO Down trick
   //  return 1;
 
-	return digitalRead(LD_PIN);
+	return digitalRead(LdPin);
 }
 
-void ADF4351::GetREGS(uint32_t *reg)
+ADF_TEMPLATE
+void ADF_CLASS::GetREGS(uint32_t *reg)
 {
 int c;
 
-  BuildAllREG();
-  
   for(c=0;c<6;c++)
     reg[c]=REG[c];
 
 }
 
-void ADF4351::PutREGS(uint32_t *reg)
+ADF_TEMPLATE
+void ADF_CLASS::PutREGS(uint32_t *reg, uint64_t freq)
 {
+PLLRef ref;
 int c;
 
   for(c=0;c<6;c++)
-    REG[c]=reg[c];
+    REG[c]=(reg[c] & ~7) | c;
+  if(!Optimize)
+    FixRef();
+
+  ReadPlan(&ref);
+  PLLPlanWords(freq, &ref, &Plan);
+  if(!freq)
+    Plan.Err_mHz = 0;
 
   WriteAllREG();
 
 }
 
-/* Private Functions ============================================================*/
+ADF_TEMPLATE
+int ADF_CLASS::SetREG(uint32_t word)
+{
+uint8_t num;
+
+  num = word & 7;
+  if(num>5)
+    return 1;
+
+  REG[num]=word;
+  if(num==2 && !Optimize)
+    FixRef();
+  WriteAllREG();
+  return 0;
+}
 
-void ADF4351::BuildAllREG()
+ADF_TEMPLATE
+void ADF_CLASS::ClearLockStats(void)
 {
 int c;
 
- 	// Write the registers
-  for(c=5;c>-1;c--)
-  { 
-	  BuildREG(c);
+  noInterrupts();
+  for(c=0;c<7;c++)
+  {
+    LockTime[c].Count = LockTime[c].Sum_us = LockTime[c].Max_us = 0;
+    LockTime[c].Min_us = 0xFFFFFFFF;
   }
+  Unlocks = 0;
+  interrupts();
+}
 
-}void ADF4351::WriteAllREG()
+ADF_TEMPLATE
+void ADF_CLASS::GetLockStats(LockStat* stat, uint32_t* unlocks)
 {
 int c;
 
- 	// Write the registers
-  for(c=5;c>-1;c--)
-  { 
-	  WriteREG(REG[c]);
+  noInterrupts();
+  for(c=0;c<7;c++)
+    stat[c] = LockTime[c];
+  *unlocks = Unlocks;
+  interrupts();
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::LockEdge(void)
+{
+LockStat *s;
+uint32_t dt;
+uint8_t level;
+
+  level = digitalRead(LdPin);
+  if(level==LdLevel)
+    return;               // another chip's pin
+  LdLevel = level;
+
+  if(!level)
+  {
+    if(!LockPending)
+      Unlocks++;          // lost lock on its own
+    if(LockHook)
+      LockHook(this, LOCK_FALL);
+    return;
+  }
+
+  if(!LockPending)
+  {
+    if(LockHook)
+      LockHook(this, LOCK_RISE);
+    return;
+  }
+  LockPending = 0;
+  if(LockHook)
+    LockHook(this, LOCK_RISE);
+
+  dt = micros() - LatchedAt_us;
+  s = &LockTime[LatchedBand];
+  s->Count++;
+  s->Sum_us += dt;
+  if(dt < s->Min_us)
+    s->Min_us = dt;
+  if(dt > s->Max_us)
+    s->Max_us = dt;
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::LockISR(void)
+{
+uint8_t c;
+
+  for(c=0;c<ChipCount;c++)
+    Chips[c]->LockEdge();
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::SetFastSettle(bool on)
+{
+  FastSettle = on;
+  LastVCO = 0;
+  if(Cache)
+    Cache->Clear();   // cached band select dividers are for the other mode
+
+  if(!on)
+  {
+    Set(ADF_CLK_DIV_MODE, 0);
+    Set(ADF_CSR, 0);
+  }
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::SetOptimize(bool on)
+{
+  Optimize = on;
+  if(Cache)
+    Cache->Clear();   // cached reference paths are for the other mode
+
+  if(!on)
+  {
+    FixRef();
+    Set(ADF_PRESCALER, adfFields[ADF_PRESCALER].Reset);
+  }
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::PlanRef(PLLRef *ref)
+{
+  ref->fREF = RefHz + REFin_Err;
+  ref->RCounter = Get(ADF_R_COUNTER);
+  ref->Doubler = Get(ADF_REF_X2);
+  ref->Divider = Get(ADF_RDIV2);
+  ref->Prescaler = Get(ADF_PRESCALER);
+}
+
+ADF_TEMPLATE
+uint32_t ADF_CLASS::RefPFD(void)
+{
+  return (uint64_t)(RefHz + REFin_Err) * DK / RK;
+}
+
+/* Private Functions ============================================================*/
+
+ADF_TEMPLATE
+void ADF_CLASS::SettleMode(uint64_t fVCO)
+{
+uint64_t jump;
+
+  if(!FastSettle)
+    return;
+
+  jump = fVCO>LastVCO ? fVCO-LastVCO : LastVCO-fVCO;
+  if(!LastVCO || jump>ADF_FASTLOCK_JUMP || Get(ADF_RF_DIV)!=adfGet(SentREG[4],ADF_RF_DIV))
+  {
+    Set(ADF_CLK_DIV, adfFastLockTimer(Plan.fPFD, Plan.Modulus, ADF_FASTLOCK_US));
+    Set(ADF_CLK_DIV_MODE, 1);
+  }
+  else
+    Set(ADF_CLK_DIV_MODE, 0);
+
+  Set(ADF_CSR, Get(ADF_RDIV2) && Get(ADF_CP_CURRENT)==0);
+  LastVCO = fVCO;
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::GetRef(PLLRef *ref)
+{
+  ref->fREF = RefHz + REFin_Err;
+  ref->RCounter = RCounter;
+  ref->Doubler = Doubler;
+  ref->Divider = Divider;
+  // the optimizer's prescaler is part of the plan, not of the setup
+  ref->Prescaler = Optimize ? adfFields[ADF_PRESCALER].Reset : Get(ADF_PRESCALER);
+}
+
+ADF_TEMPLATE
+int ADF_CLASS::ApplyFreq(uint64_t freq, uint16_t mod)
+{
+PLLRef ref;
+uint8_t err;
+
+  GetRef(&ref);
+  if(mod)
+    err = PLLPlanFreqMod(freq,&ref,mod,&Plan);
+  else if(Optimize)
+    err = PLLPlanBest(freq,&ref,&Plan);
+  else
+    err = PLLPlanFreqK<RK,DK>(freq,ref.fREF,ref.Prescaler,&Plan);
+  if(err)
+  {
+    Trace64(TRACE_ERR, TR_PLAN_FAIL, freq);
+    return 1;
+  }
+  Trace(TRACE_PLAN, TR_PLAN_PFD, Plan.fPFD, Plan.RFDivider);
+
+  // reference path: the search's, or the template's
+  if(Optimize && !mod)
+  {
+    Set(ADF_R_COUNTER, ref.RCounter);
+    Set(ADF_REF_X2, ref.Doubler);
+    Set(ADF_RDIV2, ref.Divider);
+  }
+  else
+    FixRef();
+  Set(ADF_PRESCALER, ref.Prescaler);
+
+  // band select clock at most 125 kHz, or 500 kHz fast (254 max divider)
+  if(Optimize && !mod)
+    Set(ADF_BS_DIV, FastSettle ? adfBandSelDiv(Plan.fPFD, 500000, 254) : adfBandSelDiv(Plan.fPFD, 125000, 255));
+  else
+    Set(ADF_BS_DIV, FastSettle ? BandSelDivFast : BandSelDiv);
+  Set(ADF_RF_DIV, Plan.RFDivider);
+
+  Set(ADF_INT, Plan.Integer);
+  Set(ADF_FRAC, Plan.Fractional);
+  Set(ADF_MOD, Plan.Modulus);
+
+  if(Plan.Fractional==0 && !mod)
+  {
+    // ---------------------------------- we're in integer-N Mode
+    Set(ADF_LDF, 1);
+    Set(ADF_LDP, 1);
+    Set(ADF_ABP, 1);
+    Set(ADF_CHG_CANCEL, 1);
+  }
+  else
+  {
+    // -------------------------------- we're in fractional-N Mode
+    Set(ADF_LDF, 0);
+    Set(ADF_LDP, 0);
+    Set(ADF_ABP, 0);
+    Set(ADF_CHG_CANCEL, 0);
   }
 
+  Trace(TRACE_PLAN, TR_PLAN_NM, Plan.Integer, (uint32_t)Plan.Fractional<<16 | Plan.Modulus);
+  Trace(TRACE_PLAN, TR_PLAN_ERR, (int32_t)Plan.Err_mHz);
+
+  return 0;
 }
 
-void ADF4351::BuildREG(uint8_t num)
+ADF_TEMPLATE
+void ADF_CLASS::WriteAllREG()
 {
-  switch(num)
+uint8_t mask;
+int c;
+
+  mask=DirtyMask();
+  if(TraceOn(TRACE_SPI))
+    for(c=5;c>-1;c--)
+      if(mask & (1<<c))
+        Trace(TRACE_SPI, TR_WORD, REG[c]);
+  SendREG(mask);
+
+}
+
+ADF_TEMPLATE
+uint8_t ADF_CLASS::DirtyMask()
+{
+uint8_t mask;
+int c;
+
+  mask=0;
+  for(c=0;c<6;c++)
+    if(!(SentValid & (1<<c)) || REG[c]!=SentREG[c])
+      mask |= 1<<c;
+
+  // R0 write latches the double-buffered fields (R1, R2 and the R4
+  // RF divider select) and starts the VCO band selection, so it must
+  // follow any of them, even when R0 itself didn't change
+  if((mask & 0x06) || !(SentValid & 0x10) || ((REG[4]^SentREG[4]) & adfMask(ADF_RF_DIV)))
+    mask |= 1;
+
+  return mask;
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::SendREG(uint8_t mask)
+{
+int c;
+
+  SendStart(mask);
+  for(c=5;c>-1;c--)
+    if(mask & (1<<c))
+      ShiftREG(REG[c]);
+  SendDone(mask);
+
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::SendStart(uint8_t mask)
+{
+  // R0 restarts the lock: LD falls with it, expected, and the time till
+  // it rises again is the lock time
+  if(mask & 1)
   {
-    default:
-      return;
-    case 0:
-    	REG[0] = 0x00000000 |
-        (uint32_t)(R0.Integer) << 15 |
-		    (uint32_t)(R0.Fractional) << 3 ;
-      break;
-    case 1:
-      REG[1] = 0x00000001 |
-        (uint32_t)(R1.PhaseAdjust) << 28 |
-        (uint32_t)(R1.Prescaler) << 27 |	
-        (uint32_t)(R1.PhaseVal) << 15 |
-        (uint32_t)(R1.Modulus) << 3 ;
-      break;
-    case 2:
-      REG[2] = 0x00000002 |
-        (uint32_t)(R2.NoiseMode) << 29 |
-        (uint32_t)(R2.MUXOut) << 26 |
-        (uint32_t)(R2.RefDoubler) << 25 |
-        (uint32_t)(R2.RefDivider) << 24 |
-        (uint32_t)(R2.RCounter) << 14 |
-        (uint32_t)(R2.DoubleBuffer) << 13 |
-        (uint32_t)(R2.ChargePumpCurrent) << 9 |
-        (uint32_t)(R2.LDF) << 8 |
-        (uint32_t)(R2.LDP) << 7 |
-        (uint32_t)(R2.PDPolarity) << 6 |
-        (uint32_t)(R2.PowerDown) << 5 |
-        (uint32_t)(R2.CPTri) << 4 |
-        (uint32_t)(R2.CounterReset) << 3 ;
-      break;
-    case 3:
-      REG[3] = 0x00000003 |
-        (uint32_t)(R3.res2) << 24 |
-        (uint32_t)(R3.BandSelectClockMode) << 23 |
-        (uint32_t)(R3.ABP) << 22 |
-        (uint32_t)(R3.ChargeCancelation) << 21 |
-        (uint32_t)(R3.res1) << 19 |
-        (uint32_t)(R3.CSR) << 18 |
-        (uint32_t)(R3.res0) << 17 |
-        (uint32_t)(R3.ClockDividerMode) << 15 |
-        (uint32_t)(R3.ClockDivider) << 3 ;
-      break;
-    case 4:
-      REG[4] = 0x00000004 |
-        (uint32_t)(R4.FBSelect) << 23 |
-        (uint32_t)(R4.RFDivider) << 20 |
-        (uint32_t)(R4.BandSelectDivider) << 12 |
-        (uint32_t)(R4.VCOPoweredDown) << 11 |
-        (uint32_t)(R4.MTLD) << 10 |
-        (uint32_t)(R4.AuxOutputSelect) << 9 | 
-        (uint32_t)(R4.AuxOutputEnabled) << 8 | 
-        (uint32_t)(R4.AuxOutputPower) << 6 | 
-        (uint32_t)(R4.RFOutputEnabled) << 5 | 
-        (uint32_t)(R4.OutputPower) << 3 ;
-      break;
-    case 5:
-      REG[5] = 0x00000005 |
-        (uint32_t)(R5.LDPinMode) << 22 |
-        (uint32_t)(R5.res1) << 19 ;
-        break;
-    case 6:
-      REG[6] = 0x00000006 |
-        (uint32_t)(R6.ExtBndSelDiv) << 3 |
-        (uint32_t)(R6.res0) << 7 |
-        (uint32_t)(R6.res1) << 8 |
-        (uint32_t)(R6.band_select_ac) << 16 |
-        (uint32_t)(R6.SDMType) << 18 |
-        (uint32_t)(R6.ShapeDitherEn) << 20 |
-        (uint32_t)(R6.DitherG) << 21 |
-        (uint32_t)(R6.SDMOrder) << 22 |
-        (uint32_t)(R6.rfouta_hi_pwr) << 24 |
-        (uint32_t)(R6.rfoutb_hi_pwr) << 25 |
-        (uint32_t)(R6.LDP_Ext) << 26 |
-        (uint32_t)(R6.res2) << 28 |
-        (uint32_t)(R6.res3) << 29 |
-        (uint32_t)(R6.Band_select_do) << 30 |
-        (uint32_t)(R6.DigLock) << 31;
-        break;
-    case 7:
-      REG[7] = 0x00000007 |
-        (uint32_t)R7.sclke << 7 |
-        (uint32_t)R7.Rd_Addr << 4 |
-        (uint32_t)R7.SPI_R_WN << 3 ;
-        break;
+    LatchedBand = adfGet(REG[4],ADF_RF_DIV);
+    if(LatchedBand>6)
+      LatchedBand = 6;
+    LatchedAt_us = micros();
+    LockPending = 1;
+    if(LockHook)
+      LockHook(this, LOCK_R0);
   }
 }
 
-void ADF4351::WriteREG(uint32_t val)
+ADF_TEMPLATE
+void ADF_CLASS::SendDone(uint8_t mask)
+{
+int c;
+
+  for(c=0;c<6;c++)
+  {
+    if(mask & (1<<c))
+    {
+      SentREG[c] = REG[c];
+      WordsWritten++;
+    }
+    else
+      WordsSkipped++;
+  }
+  SentValid |= mask;
+
+  if(mask & 1)
+    LatchedAt_us = micros();
+}
+
+ADF_TEMPLATE
+inline uint32_t ADF_CLASS::Get(uint8_t f)
+{
+  return adfGet(REG[adfFields[f].Reg],f);
+}
+
+ADF_TEMPLATE
+inline void ADF_CLASS::Set(uint8_t f, uint32_t v)
+{
+  REG[adfFields[f].Reg] = adfPut(REG[adfFields[f].Reg],f,v);
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::FixRef(void)
+{
+  Set(ADF_R_COUNTER, RCounter);
+  Set(ADF_REF_X2, Doubler);
+  Set(ADF_RDIV2, Divider);
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::ReadPlan(PLLRef *ref)
+{
+  Plan.Integer = Get(ADF_INT);
+  Plan.Fractional = Get(ADF_FRAC);
+  Plan.Modulus = Get(ADF_MOD);
+  Plan.RFDivider = Get(ADF_RF_DIV);
+  PlanRef(ref);
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::WriteREG(uint32_t val)
+{
+
+  Trace(TRACE_SPI, TR_WORD, val);
+
+  ShiftREG(val);
+
+}
+
+ADF_TEMPLATE
+void ADF_CLASS::ShiftREG(uint32_t val)
 {
 
   digitalWrite(LED_BUILTIN, HIGH);
-#ifdef DEBUG
-Serial.print("\tw");Serial.print(val&7);Serial.print(": ");Serial.println(val,HEX);
-#endif
 
 	val=__builtin_bswap32((uint32_t)val);
 	
-  digitalWrite(LE_PIN, LOW);
+  noInterrupts();         // see Several chips above
+  LeLow();
   SPI.transfer(&val,4);
-  digitalWrite(LE_PIN, HIGH);
+  LeHigh();
+  interrupts();
 
   digitalWrite(LED_BUILTIN, LOW);
 
 }
 
-uint32_t ADF4351::ReadREG(uint32_t val)
+ADF_TEMPLATE
+inline void ADF_CLASS::LeLow(void)
 {
-uint32_t rreg;
-
-  R7.Rd_Addr = val;
-  R7.SPI_R_WN = 1;
-  //R7.sclke = 1;
+#if defined(ARDUINO_ARCH_SAMD)
+  *LeClr = LeBit;
+#else
+  digitalWrite(LePin, LOW);
+#endif
+}
 
-  BuildREG(7);
-#ifdef DEBUG
-Serial.print("\tw");Serial.print((uint32_t)REG[7]&7);Serial.print(": ");Serial.println(REG[7],HEX);
+ADF_TEMPLATE
+inline void ADF_CLASS::LeHigh(void)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  *LeSet = LeBit;
+#else
+  digitalWrite(LePin, HIGH);
 #endif
+}
+
+ADF_TEMPLATE
+uint32_t ADF_CLASS::ReadREG(uint32_t val)
+{
+uint32_t rreg,wreg;
+
+  if(Chip::Registers<=7)
+    return 0;             // no readback on this chip
+
+  // read request, R7 otherwise at its reset value
+  wreg = adfPut(adfPut(adfResetWord(7),ADF_RD_ADDR,val),ADF_RD_WN,1);
+  Trace(TRACE_SPI, TR_WORD, wreg);
 
-	rreg=__builtin_bswap32((uint32_t)REG[7]);
+	rreg=__builtin_bswap32(wreg);
 	
-  digitalWrite(LE_PIN, LOW);
+  noInterrupts();
+  LeLow();
   SPI.transfer(&rreg,4);
-  digitalWrite(LE_PIN, HIGH);
-
-#ifdef DEBUG
-Serial.print("\tr");Serial.print((uint32_t)rreg&7);Serial.print(": ");Serial.println(rreg,HEX);
-#endif
+  LeHigh();
+  interrupts();
 
   rreg=__builtin_bswap32((uint32_t)rreg);
 
+  Trace(TRACE_SPI, TR_READ, val, rreg);
+
   return rreg;
   
 }
+
+// The board's chip
+typedef ADF435x<REF_XTAL, ADF_RCOUNTER, ADF_DOUBLER, ADF_DIVIDER, ADF_CHIP> ADF4351;
+
+#endif
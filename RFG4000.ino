@@ -6,265 +6,1737 @@ RFG4000 RF Signal Generator implementation
 
   Define this based on hardware wiring
 */
-#define DEBUG
+//#define DEBUG             // start up banner, waiting for the port; see sTRACE.h for the rest
 
 #define D_FREQ 4300654321
-#define D_PWR   -4
+#define D_PWR   -400   // cdBm
 #define D_OUT   1
 #define D_ROSC -530
+#define D_SWE_STAR 1000000000
+#define D_SWE_STOP 2000000000
+#define D_SWE_POIN 101
+#define D_SWE_DWEL 1000     // us
+#define D_HOP_DWEL 1000     // us
+#define D_HOP_LEN  100
+#define LOCK_GRACE_MS 4     // unlocked this long is an error
+#define OPC_TIMEOUT_MS 50   // *OPC, *OPC?, *WAI: no lock by then is an error
+#define HEARTBEAT_MS 100    // LED on one tick out of 10
+#define CHANNELS   2        // synthesizers on the SPI bus, SOURce1..n
+#define LE2_PIN    6        // second one's LE and LD, first's in ADF4351.h
+#define LD2_PIN    7
 /*
 \*------------------------------------------------------------------------------*/
 
-//#include <EEPROM.h>
 #include "ADF4351.h"
 #include "sSCPI.h"
+#include "sBENCH.h"
+#include "sSWEEP.h"
+#include "sBIN.h"
+#include "sTASK.h"
+#include "sHOP.h"
+#include "sSTORE.h"
+#include "sSTATUS.h"
 
 sSCPI scpi;
-ADF4351 sigGen;
+sCACHE planCache;                 // channel 1 only: the others plan every time
+ADF4351 sigGen(LE_PIN, LD_PIN, &planCache); // channel 1: also sweep, hop, store, binary
+ADF4351 sigGen2(LE2_PIN, LD2_PIN);
+ADF4351 *synth[CHANNELS] = {&sigGen, &sigGen2};
+sSWEEP sweep;
+sBIN bin;
+sHOP hop;
+sSTORE store;
 
-double currFreq;
-float currPwr,currROsc;
+uint64_t currFreq[CHANNELS];
+int16_t currPwr[CHANNELS];      // cdBm
+int32_t currROsc;
+bool currOut[CHANNELS];
 
-bool serrFLOCK;
+bool serrFLOCK[CHANNELS];
+uint32_t unlockSince[CHANNELS];
 int OOK;
-uint32_t R[6];
 uint32_t heartbeat;
 
-/*
-bool ReadEE()
+uint64_t sweepStart,sweepStop;
+uint16_t sweepPoints;
+uint32_t sweepDwell_us;
+uint64_t listFreq[SWEEP_MAX];
+uint16_t listPoints;
+bool listRaw;                   // list points are words, LIST:REGister
+uint32_t listWord[5];
+int listWordAt;                 // point they go to, -1 none
+
+uint64_t allFreq[CHANNELS];
+bool allBad;
+
+uint64_t hopStart,hopSpacing;
+uint16_t hopLength;
+uint32_t hopSeed;               // of the last HOP:SEQ:RAND
+uint32_t hopDwell_us;
+bool hopSync;
+
+bool opcArmed;                  // *OPC, waiting for the retunes to lock
+uint32_t opcSince;
+volatile uint8_t opcExpired;    // by channel: timed out, not waited on again till its next R0
+
+volatile uint8_t chLocked;      // by channel, bit 0 is SOURce1: LD up
+volatile uint8_t chSettling;    // R0 sent, LD not up since
+volatile uint8_t chUnlocked;    // LD down with no retune, or past LOCK_GRACE_MS
+
+void InitParms(bool tune=1);
+void TuneDefault(void);
+bool TimedRun(void);
+void RunStatus(void);
+int Channel(void);
+uint32_t TuneFreq(uint8_t ch, int64_t Freq);
+uint32_t TuneOut(uint8_t ch, bool on);
+
+// Value formats: unit, fixed point digits, MIN, MAX, DEF
+const sSCPI::Number numFreq   = {sSCPI::UNIT_HZ,  0, 35000000, 4400000000LL, D_FREQ};
+const sSCPI::Number numStart  = {sSCPI::UNIT_HZ,  0, 35000000, 4400000000LL, D_SWE_STAR};
+const sSCPI::Number numStop   = {sSCPI::UNIT_HZ,  0, 35000000, 4400000000LL, D_SWE_STOP};
+const sSCPI::Number numStep   = {sSCPI::UNIT_HZ,  0, 1, 4400000000LL, (D_SWE_STOP-D_SWE_STAR)/(D_SWE_POIN-1)};
+const sSCPI::Number numPower  = {sSCPI::UNIT_DBM, 2, -400, 500, D_PWR};
+const sSCPI::Number numPoints = {sSCPI::UNIT_NONE,0, 2, SWEEP_MAX, D_SWE_POIN};
+const sSCPI::Number numDwell  = {sSCPI::UNIT_S,   6, SWEEP_DWELL_MIN, 60000000, D_SWE_DWEL};
+const sSCPI::Number numROsc   = {sSCPI::UNIT_HZ,  0, -100000, 100000, D_ROSC};
+const sSCPI::Number numSpacing= {sSCPI::UNIT_HZ,  0, 1, 4400000000LL, 1000000};
+const sSCPI::Number numChans  = {sSCPI::UNIT_NONE,0, 1, HOP_CHANNELS, 1};
+const sSCPI::Number numHopLen = {sSCPI::UNIT_NONE,0, 1, HOP_MAX, D_HOP_LEN};
+const sSCPI::Number numHopDwel= {sSCPI::UNIT_S,   6, HOP_DWELL_MIN, 60000000, D_HOP_DWEL};
+const sSCPI::Number numTrMask = {sSCPI::UNIT_NONE,0, 0, 255, TRACE_MASK};
+const sSCPI::Number numByte   = {sSCPI::UNIT_NONE,0, 0, 255, 0};
+const sSCPI::Number numStatEn = {sSCPI::UNIT_NONE,0, 0, 32767, 0};
+
+// Instrument state in a store slot: the register words ready to send, and
+// what the SCPI queries answer
+struct SavedState
+{
+  uint32_t REG[6];
+  uint64_t Freq;
+  int32_t ROsc;
+  int16_t Pwr;
+  uint8_t Out;
+  uint8_t Modes;        // bit 0 fast settle, bit 1 plan optimizer
+};
+
+// Put a saved state back: no planning, just the words. 0 if none in slot
+bool RecallState(uint8_t slot)
+{
+SavedState st;
+int c;
+
+  if(store.Load(slot,&st,sizeof(st))!=sizeof(st))
+    return 0;
+
+  sweep.Stop();
+  hop.Stop();
+  RunStatus();
+  sigGen.SetFastSettle(st.Modes & 1);
+  sigGen.SetOptimize((st.Modes & 2)!=0);
+  sigGen.PutREGS(st.REG,st.Freq);
+
+  currFreq[0]=st.Freq;
+  currPwr[0]=st.Pwr;
+  currOut[0]=st.Out;
+
+  // one reference for all of them, as ROSC:ADJ:VAL: the others are
+  // planned again on it
+  for(c=0;c<CHANNELS;c++)
+    synth[c]->REFin_Err = st.ROsc;
+  currROsc=st.ROsc;
+  for(c=1;c<CHANNELS;c++)
+    TuneFreq(c,currFreq[c]);
+  Trace(TRACE_CMD, TR_RECALL, slot);
+  return 1;
+}
+
+// Set the output frequency
+// Parameter is f in Hz
+uint32_t CenterFrequency(int64_t Freq, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(currFreq[ch]);
+    return 0;
+  }
+
+  return TuneFreq(ch,Freq);
+}
+
+// Channel of the command, from the header suffix: SOUR2:FREQ is 1.
+// -1 and an error when there is no such channel
+int Channel(void)
+{
+  if(scpi.Suffix()<1 || scpi.Suffix()>CHANNELS)
+  {
+    scpi.PushError(ERR_SUFFIX_RANGE);
+    return -1;
+  }
+  return scpi.Suffix()-1;
+}
+
+// Sweep, list and hop commands: they run on channel 1 only, SOUR2:SWE is
+// -114 too. Said once for a command with a list of values
+bool SweepChannel(void)
+{
+  if(scpi.Suffix()!=1)
+  {
+    if(scpi.ArgIndex()==0)
+      scpi.PushError(ERR_SUFFIX_RANGE);
+    return 0;
+  }
+  return 1;
+}
+
+// Sweep and hop run on channel 1 only
+uint32_t TuneFreq(uint8_t ch, int64_t Freq)
+{
+  if(ch==0 && TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+  
+  Trace64(TRACE_CMD, TR_FREQ, Freq);
+
+  // range is 35M - 4400M
+  if(Freq<numFreq.min || Freq>numFreq.max)
+  {
+    scpi.PushError(ERR_FREQ_RANGE);
+    return 1; // comment just this line to check for frequencies unlocking the PLL
+  }  
+
+  if(synth[ch]->SetFreq(Freq))
+  {
+    scpi.PushError(ERR_UNCOMPUTABLE);
+    return 1;
+  };
+  currFreq[ch]=Freq;
+  return 0;
+}
+
+// All channels at once, one frequency each: every one planned first, then
+// sent back to back with their R0s latched together (ADF435x::SendAll)
+uint32_t AllFrequency(int64_t Freq, bool qry)
+{
+uint8_t i;
+int c;
+
+  if(qry)
+  {
+    for(c=0;c<CHANNELS;c++)
+      resp.Uint(currFreq[c]);
+    return 0;
+  }
+
+  i = scpi.ArgIndex();
+  if(i==0)
+    allBad = 0;
+  if(allBad)
+    return 1;
+  if(i>=CHANNELS)
+  {
+    allBad = 1;
+    scpi.PushError(ERR_PARAM_NOT_ALLOWED);
+    return 1;
+  }
+  if(Freq<numFreq.min || Freq>numFreq.max)
+  {
+    allBad = 1;
+    scpi.PushError(ERR_FREQ_RANGE);
+    return 1;
+  }
+
+  allFreq[i] = Freq;
+  if(i<CHANNELS-1)
+    return 0;         // the rest still to come
+
+  if(TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  // the channels planned before a failure are prepared: they go out
+  // all the same, so they're current
+  for(c=0;c<CHANNELS;c++)
+  {
+    if(synth[c]->PrepareFreq(allFreq[c]))
+      break;
+    currFreq[c]=allFreq[c];
+  }
+  ADF4351::SendAll(synth,CHANNELS);
+  if(c<CHANNELS)
+  {
+    scpi.PushError(ERR_UNCOMPUTABLE);
+    return 1;
+  }
+  return 0;
+}
+
+
+uint32_t RFPower(int64_t pwr, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Fixed(currPwr[ch],2);
+    return 0;    
+  }
+
+  if(ch==0 && TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  Trace(TRACE_CMD, TR_POWER, (int32_t)pwr);
+  if(pwr<numPower.min || pwr>numPower.max)
+  {
+    scpi.PushError(ERR_POWER_RANGE);
+    return 1;
+  }
+  synth[ch]->SetPower(pwr);
+  currPwr[ch]=pwr;
+  return 0;
+}
+
+
+// Fast settle mode, see ADF4351.h. Retunes to apply it
+uint32_t FastSettle(int64_t on, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(synth[ch]->FastSettle ? 1 : 0);
+    return 0;
+  }
+
+  if(ch==0 && TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  synth[ch]->SetFastSettle(on!=0);
+  synth[ch]->SetFreq(currFreq[ch]);
+  return 0;
+}
+
+// Plan optimizer, see ADF4351.h. Retunes to apply it
+uint32_t PlanOptimize(int64_t on, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(synth[ch]->Optimize ? 1 : 0);
+    return 0;
+  }
+
+  if(ch==0 && TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  synth[ch]->SetOptimize(on!=0);
+  synth[ch]->SetFreq(currFreq[ch]);
+  return 0;
+}
+
+// Plan of the current frequency: fPFD (Hz),R counter,doubler,RDIV2,
+// prescaler (4 or 8),INT,FRAC,MOD,RF divider (1..64),error (mHz)
+uint32_t FreqPlan(int64_t na, bool qry)
+{
+PLLRef ref;
+PLLPlan *p;
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    p = &synth[ch]->Plan;
+    synth[ch]->PlanRef(&ref);
+    resp.Uint(p->fPFD);
+    resp.Uint(ref.RCounter);
+    resp.Uint(ref.Doubler ? 1 : 0);
+    resp.Uint(ref.Divider ? 1 : 0);
+    resp.Uint(ref.Prescaler ? 8 : 4);
+    resp.Uint(p->Integer);
+    resp.Uint(p->Fractional);
+    resp.Uint(p->Modulus);
+    resp.Uint(1<<p->RFDivider);
+    resp.Int(p->Err_mHz);
+    return 0;
+  }
+
+  return 1;
+}
+
+// PLL lock state of the channel, 1 locked
+uint32_t PLLLocked(int64_t na, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(synth[ch]->FreqLocked() ? 1 : 0);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Enable or disable RF output
+// Parameter is 1 for enable and 0 for disable
+uint32_t SetRFOut(int64_t rfout, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(currOut[ch] ? 1 : 0);
+    return 0;
+  }
+
+  return TuneOut(ch,(bool)rfout);
+}
+
+uint32_t TuneOut(uint8_t ch, bool on)
+{
+  if(ch==0 && TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+  
+  synth[ch]->SetOut(on);
+  currOut[ch]=on;
+  return 0;
+}
+
+
+
+// Sweep start and stop frequencies
+// Parameter is f in Hz
+uint32_t SweepStart(int64_t Freq, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweepStart);
+    return 0;
+  }
+
+  if(Freq<numFreq.min || Freq>numFreq.max)
+  {
+    scpi.PushError(ERR_FREQ_RANGE);
+    return 1;
+  }
+  sweepStart=Freq;
+  return 0;
+}
+
+uint32_t SweepStop(int64_t Freq, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweepStop);
+    return 0;
+  }
+
+  if(Freq<numFreq.min || Freq>numFreq.max)
+  {
+    scpi.PushError(ERR_FREQ_RANGE);
+    return 1;
+  }
+  sweepStop=Freq;
+  return 0;
+}
+
+// Number of sweep points, start and stop included
+uint32_t SweepPoints(int64_t points, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweepPoints);
+    return 0;
+  }
+
+  if(points<numPoints.min || points>numPoints.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  sweepPoints=points;
+  return 0;
+}
+
+// Sweep step, in Hz. Sets the number of points from start to stop
+uint32_t SweepStep(int64_t step, bool qry)
+{
+uint64_t span;
+
+  if(!SweepChannel())
+    return 1;
+
+  span = sweepStop>sweepStart ? sweepStop-sweepStart : sweepStart-sweepStop;
+  if(qry)
+  {
+    resp.Uint(span/(sweepPoints-1));
+    return 0;
+  }
+
+  if(step<=0 || span/(uint64_t)step+1 > SWEEP_MAX)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  sweepPoints=span/step+1;
+  if(sweepPoints<2)
+    sweepPoints=2;
+  return 0;
+}
+
+// Dwell time per point, in seconds, read in us
+uint32_t SweepDwell(int64_t dwell, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Fixed(sweepDwell_us,6);
+    return 0;
+  }
+
+  if(dwell<numDwell.min || dwell>numDwell.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  sweepDwell_us=dwell;
+  return 0;
+}
+
+// Frequency list, in Hz, as comma separated values
+uint32_t ListFreq(int64_t Freq, bool qry)
+{
+int c;
+
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    for(c=0;c<listPoints && !listRaw;c++)
+      resp.Uint(listFreq[c]);
+    if(c==0)
+      resp.Str("");       // empty list, still an answer
+    return 0;
+  }
+
+  if(scpi.ArgIndex()==0)
+  {
+    listPoints=0;
+    listRaw=0;
+  }
+
+  if(Freq<numFreq.min || Freq>numFreq.max || listPoints>=SWEEP_MAX)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  listFreq[listPoints++]=Freq;
+  return 0;
+}
+
+// List point as register words: idx,R0,R1,R2,R3,R4, as planned offline
+// by the host plan compiler (host/plan.cpp). Points go in order from 0,
+// which starts a new list
+uint32_t ListRegs(int64_t val, bool qry)
+{
+uint8_t a;
+
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+    return 1;
+
+  if(sweep.Running())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  a = scpi.ArgIndex();
+  if(a==0)
+  {
+    if(val==0)
+    {
+      listPoints=0;
+      listRaw=1;
+    }
+    listWordAt=-1;
+    if(val!=listPoints || !listRaw || val>=SWEEP_MAX)
+    {
+      scpi.PushError(ERR_DATA_RANGE);
+      return 1;
+    }
+    listWordAt=val;
+    return 0;
+  }
+
+  if(listWordAt<0)
+    return 1;             // bad index, already said
+  if(a>5 || val<0 || val>0xFFFFFFFFLL)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  listWord[a-1]=val;
+  if(a==5)
+  {
+    sweep.Put(listWordAt,listWord);
+    listPoints=listWordAt+1;
+  }
+  return 0;
+}
+
+// Start or stop the sweep, from start/stop/points or from the list
+// Parameter is 1 for start and 0 for stop
+uint32_t RunSweep(bool on, bool list)
+{
+uint16_t c,n;
+uint64_t f,f0,f1;
+
+  if(!on)
+  {
+    if(sweep.Running())
+    {
+      sweep.Stop();
+      RunStatus();
+      sigGen.SetFreq(currFreq[0]);   // back to CW
+    }
+    return 0;
+  }
+
+  sweep.Stop();
+  hop.Stop();
+  RunStatus();
+  n = list ? listPoints : sweepPoints;
+  if(!list && listRaw)
+    listPoints=0;         // its words are about to be overwritten
+  f0 = sweepStart;
+  f1 = sweepStop;
+  for(c=0;c<n;c++)
+  {
+    if(list)
+      f = listFreq[c];
+    else if(f1>=f0)
+      f = f0 + (f1-f0)*c/(n-1);
+    else
+      f = f0 - (f0-f1)*c/(n-1);
+
+    if(list && listRaw)
+      continue;
+    if(sweep.Load(&sigGen,c,f))
+    {
+      scpi.PushError(ERR_UNCOMPUTABLE);
+      return 1;
+    }
+  }
+
+  if(!sweep.Start(&sigGen,n,sweepDwell_us))
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  RunStatus();
+  return 0;
+}
+
+uint32_t SweepState(int64_t on, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweep.Running() ? 1 : 0);
+    return 0;
+  }
+
+  return RunSweep(on!=0,0);
+}
+
+uint32_t ListState(int64_t on, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweep.Running() ? 1 : 0);
+    return 0;
+  }
+
+  return RunSweep(on!=0,1);
+}
+
+// Measured sweep rate, in points per second
+uint32_t SweepRate(int64_t na, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(sweep.Rate());
+    return 0;
+  }
+
+  return 1;
+}
+
+
+
+uint32_t GetIDN(int64_t, bool qry)
+{
+  if(qry)
+  {
+    resp.Str("Mojon City,RFG4000,230001,1.0");
+    return 0;
+  }
+
+  return 1;
+}
+
+// Perform RST
+uint32_t DoRST(int64_t na, bool qry)
+{
+  Trace(TRACE_CMD, TR_RST);
+  InitParms();
+  return 0;
+}
+
+// Save the state to a slot, 0..STORE_SLOTS-1. Slot 0 is the power on state
+uint32_t SaveSlot(int64_t slot, bool qry)
+{
+SavedState st;
+
+  if(slot<0 || slot>=STORE_SLOTS)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+
+  if(TimedRun())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  memset(&st,0,sizeof(st));
+  sigGen.GetREGS(st.REG);
+  st.Freq=currFreq[0];
+  st.ROsc=currROsc;
+  st.Pwr=currPwr[0];
+  st.Out=currOut[0];
+  st.Modes=(sigGen.FastSettle ? 1 : 0) | (sigGen.Optimize ? 2 : 0);
+  if(!store.Save(slot,&st,sizeof(st)))
+  {
+    scpi.PushError(ERR_MASS_STORAGE);
+    return 1;
+  }
+  return 0;
+}
+
+// Recall the state in a slot
+uint32_t RecallSlot(int64_t slot, bool qry)
+{
+  if(slot<0 || slot>=STORE_SLOTS)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+
+  if(!RecallState(slot))
+  {
+    scpi.PushError(ERR_MASS_STORAGE);
+    return 1;
+  }
+  return 0;
+}
+
+// Operations pending: a channel waiting for lock after its last R0 write.
+// Sweeps and hops never end, so they don't count, nor does a retune that
+// already timed out
+bool Settling(void)
+{
+int c;
+
+  for(c=0;c<CHANNELS;c++)
+    if(synth[c]->Settling() && !(c==0 && TimedRun()) && !(opcExpired & (1<<c)))
+      return 1;
+  return 0;
+}
+
+// The pending retunes took too long: one error for them, about header
+// node, then they're not waited on any more
+void OpcExpire(uint8_t node)
+{
+int c;
+
+  scpi.PushError(ERR_LOCK_TIMEOUT, node);
+  noInterrupts();
+  for(c=0;c<CHANNELS;c++)
+    if(synth[c]->Settling())
+      opcExpired |= 1<<c;
+  interrupts();
+}
+
+// Wait for the pending operations, tasks and replies going on meanwhile.
+// 0 if they didn't end within OPC_TIMEOUT_MS
+bool OpcWait(void)
+{
+uint32_t t0;
+
+  t0 = millis();
+  while(Settling())
+  {
+    if(millis()-t0 >= OPC_TIMEOUT_MS)
+    {
+      OpcExpire(sSCPI::NODE_HANDLED);
+      return 0;
+    }
+    TaskRun();
+    resp.Drain();
+  }
+  return 1;
+}
+
+// *OPC? answers 1 once every retune so far has locked, or timed out with
+// an error. *OPC sets operation complete then, without waiting
+uint32_t OpcCmd(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    OpcWait();
+    resp.Uint(1);
+    return 0;
+  }
+
+  opcArmed = 1;
+  opcSince = millis();
+  return 0;
+}
+
+// *WAI: nothing more is read until every retune so far has locked
+uint32_t WaiCmd(int64_t na, bool qry)
+{
+  if(qry)
+    return 1;
+
+  OpcWait();
+  return 0;
+}
+
+// Status -----------------------------------------------------------------------
+// Lock and settling conditions from the channel masks. The masks change
+// from the LD interrupt too: read and write them with interrupts off
+void LockStatusLocked(void)
+{
+  status.ConditionLocked(sSTATUS::OPER, STAT_OPER_SETTLING | STAT_OPER_LOCKED,
+    (chSettling ? STAT_OPER_SETTLING : 0) | (chLocked==(1<<CHANNELS)-1 ? STAT_OPER_LOCKED : 0));
+  status.ConditionLocked(sSTATUS::QUES, STAT_QUES_FREQ, chUnlocked ? STAT_QUES_FREQ : 0);
+}
+
+void LockStatus(void)
+{
+  noInterrupts();
+  LockStatusLocked();
+  interrupts();
+}
+
+// R0 writes and LD edges of every channel, from the interrupts too
+void LockEvent(ADF4351 *chip, uint8_t event)
+{
+uint8_t c,bit;
+
+  for(c=0;c<CHANNELS && synth[c]!=chip;c++)
+    ;
+  bit = 1<<c;
+
+  noInterrupts();
+  switch(event)
+  {
+    case ADF4351::LOCK_R0:
+      chSettling |= bit;
+      opcExpired &= ~bit;     // a new operation, waited on again
+      break;
+    case ADF4351::LOCK_RISE:
+      chLocked |= bit;
+      chSettling &= ~bit;
+      chUnlocked &= ~bit;
+      break;
+    case ADF4351::LOCK_FALL:
+      chLocked &= ~bit;
+      if(!chip->Settling())
+        chUnlocked |= bit;    // lost it on its own
+      break;
+  }
+  LockStatusLocked();
+  interrupts();
+}
+
+// Sweeping and hopping conditions, after a start or stop
+void RunStatus(void)
+{
+  status.Condition(sSTATUS::OPER, STAT_OPER_SWEEPING | STAT_OPER_HOPPING,
+    (sweep.Running() ? STAT_OPER_SWEEPING : 0) | (hop.Running() ? STAT_OPER_HOPPING : 0));
+}
+
+// *STB? status byte, see sSTATUS.h. Reading doesn't clear it
+uint32_t StatusByte(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(status.STB());
+    return 0;
+  }
+
+  return 1;
+}
+
+// *ESR? standard events, cleared by reading
+uint32_t EventStatus(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(status.ReadESR());
+    return 0;
+  }
+
+  return 1;
+}
+
+// *ESE standard events summarized in the status byte
+uint32_t EventEnable(int64_t mask, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(status.ESE);
+    return 0;
+  }
+
+  if(mask<numByte.min || mask>numByte.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  status.ESE = mask;
+  return 0;
+}
+
+// *SRE status byte bits making the master summary
+uint32_t ServiceEnable(int64_t mask, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(status.SRE);
+    return 0;
+  }
+
+  if(mask<numByte.min || mask>numByte.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  status.SRE = mask & ~STB_MSS;
+  return 0;
+}
+
+// *CLS event registers and error queue cleared, *OPC forgotten
+uint32_t ClearStatus(int64_t na, bool qry)
+{
+  if(qry)
+    return 1;
+
+  status.Clear();
+  scpi.ClearErrors();
+  opcArmed = 0;
+  return 0;
+}
+
+// STAT:OPER and STAT:QUES registers: EVENt? reads and clears,
+// CONDition? reads, ENABle sets
+uint32_t StatusReg(uint8_t reg, uint8_t part, int64_t v, bool qry)
+{
+  if(part!=2 && !qry)
+    return 1;
+
+  switch(part)
+  {
+    case 0:
+      resp.Uint(status.ReadEvent(reg));
+      break;
+    case 1:
+      resp.Uint(status.GetCondition(reg));
+      break;
+    default:
+      if(qry)
+      {
+        resp.Uint(status.Enable[reg]);
+        break;
+      }
+      if(v<numStatEn.min || v>numStatEn.max)
+      {
+        scpi.PushError(ERR_DATA_RANGE);
+        return 1;
+      }
+      status.Enable[reg] = v;
+      break;
+  }
+  return 0;
+}
+
+uint32_t OperEvent(int64_t v, bool qry)  { return StatusReg(sSTATUS::OPER,0,v,qry); }
+uint32_t OperCond(int64_t v, bool qry)   { return StatusReg(sSTATUS::OPER,1,v,qry); }
+uint32_t OperEnable(int64_t v, bool qry) { return StatusReg(sSTATUS::OPER,2,v,qry); }
+uint32_t QuesEvent(int64_t v, bool qry)  { return StatusReg(sSTATUS::QUES,0,v,qry); }
+uint32_t QuesCond(int64_t v, bool qry)   { return StatusReg(sSTATUS::QUES,1,v,qry); }
+uint32_t QuesEnable(int64_t v, bool qry) { return StatusReg(sSTATUS::QUES,2,v,qry); }
+
+// STAT:PRES enables back to their defaults
+uint32_t StatusPreset(int64_t na, bool qry)
+{
+  if(qry)
+    return 1;
+
+  status.Preset();
+  return 0;
+}
+
+// Read the ERROR pool
+uint32_t SysError(int64_t na, bool qry)
+{
+char text[64];
+
+  if(qry)
+  {
+    scpi.PullError(text,sizeof(text));
+    resp.Str(text);
+    return 0;
+  }
+
+  //push error ?
+  return 1;
+}
+
+// Trace records, see sTRACE.h: sent as a block and cleared
+uint32_t TraceData(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    resp.Next();
+    TraceDump(resp);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Trace levels on, bits as TRACE_LEVELS
+uint32_t TraceMask(int64_t mask, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(traceMask);
+    return 0;
+  }
+
+  if(mask<numTrMask.min || mask>numTrMask.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  traceMask = mask & TRACE_LEVELS;
+  return 0;
+}
+
+uint32_t Impedance(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(50);
+    return 0;
+  }
+
+  //push error ?
+  return 1;
+}
+
+uint32_t GetAdjRefOsc(int64_t na, bool qry)
+{
+    resp.Int(currROsc);
+    return 0;
+}
+
+uint32_t AdjRefOsc(int64_t errHz, bool qry)
+{
+int c;
+
+  if(qry)
+  {
+    resp.Int(currROsc);
+    return 0;
+  }
+
+  // one reference for all of them
+  for(c=0;c<CHANNELS;c++)
+    synth[c]->REFin_Err = errHz;
+  currROsc=errHz;
+  return 0;
+}
+
+// Run the benchmark suite, CSV output
+uint32_t Benchmark(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    if(TimedRun())
+    {
+      scpi.PushError(ERR_SETTINGS_CONFLICT);
+      return 1;
+    }
+    resp.Flush();         // the suite prints as it goes
+    sBENCH::Suite(&sigGen,&scpi);
+    sigGen.SetFreq(currFreq[0]);   // back where we were
+    return 0;
+  }
+
+  return 1;
+}
+
+// SPI traffic: register words written and skipped
+uint32_t SPIStats(int64_t na, bool qry)
+{
+  if(qry)
+  {
+    resp.Uint(sigGen.WordsWritten);
+    resp.Uint(sigGen.WordsSkipped);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Frequency plan cache: hits and misses
+uint32_t CacheStats(int64_t na, bool qry)
 {
-int r,a;
+  if(qry)
+  {
+    resp.Uint(planCache.Hits);
+    resp.Uint(planCache.Misses);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Hopping ----------------------------------------------------------------------
+// Sweep or hops running: the timer and the synth are taken
+bool TimedRun(void)
+{
+  return sweep.Running() || hop.Running();
+}
+
+// Hop channels, in Hz, as comma separated values. Replaces all channels
+uint32_t HopChannels(int64_t Freq, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hop.Channels());
+    return 0;
+  }
 
-  if(EEPROM.read(0)==255)
+  if(hop.Running())
   {
-#ifdef DEBUG
-Serial.println("EEPROM empty");
-#endif
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
     return 1;
   }
-  for(r=0;r<6;r++)
+
+  if(scpi.ArgIndex()==0)
   {
-    a = 16 + r*32;
-    R[r]=((uint32_t)EEPROM.read(a) | (uint32_t)EEPROM.read(a+1)<<8 | (uint32_t)EEPROM.read(a+2)<<16 | (uint32_t)EEPROM.read(a+3)<<24 );
-#ifdef DEBUG
-Serial.print("EEreg_rd");Serial.print(r);Serial.print(": ");Serial.println(R[r],HEX);
-#endif
+    hop.Clear();
+    hop.Modulus=PLAN_MOD_MAX;
+  }
+
+  if(Freq<numFreq.min || Freq>numFreq.max || hop.AddChannel(&sigGen,Freq)<0)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
   }
-  sigGen.PutREGS(R);
   return 0;
 }
 
-bool WriteEE()
+// Channel plan: COUNt channels from STARt every SPACing, in Hz
+uint32_t HopChanStart(int64_t Freq, bool qry)
 {
-int r,a;
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hopStart);
+    return 0;
+  }
+
+  if(Freq<numFreq.min || Freq>numFreq.max)
+  {
+    scpi.PushError(ERR_FREQ_RANGE);
+    return 1;
+  }
+  hopStart=Freq;
+  return 0;
+}
 
-  sigGen.GetREGS(R);
+uint32_t HopChanSpacing(int64_t Freq, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
 
-  EEPROM.write(0,1);
+  if(qry)
+  {
+    resp.Uint(hopSpacing);
+    return 0;
+  }
 
-  for(r=0;r<6;r++)
+  if(Freq<numSpacing.min || Freq>numSpacing.max)
   {
-    a = 16 + r*32;
-    EEPROM.write(a,(uint8_t)R[r]);EEPROM.write(a+1,(uint8_t)(R[r]>>8));EEPROM.write(a+2,(uint8_t)(R[r]>>16));EEPROM.write(a+3,(uint8_t)(R[r]>>24));
-#ifdef DEBUG
-Serial.print("EEreg_wr");Serial.print(r);Serial.print(": ");Serial.println(R[r],HEX);
-#endif
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
   }
+  hopSpacing=Freq;
+  return 0;
 }
-*/
 
-// Set the output frequency
-// Parameter is f in Hz 
-uint32_t CenterFrequency(double Freq, bool qry)
+uint32_t HopChanCount(int64_t count, bool qry)
 {
+int c;
+
+  if(!SweepChannel())
+    return 1;
+
   if(qry)
   {
-    SerialPrintDouble(currFreq);Serial.print("\r\n");   //Serial.println((uint64_t)currFreq);
+    resp.Uint(hop.Channels());
     return 0;
   }
-  
-#ifdef DEBUG
-Serial.print("Set frequency @ ");
-SerialPrintDouble(Freq);Serial.print("\r\n");  //Serial.println((uint64_t)Freq);
-#endif  
 
-  // range is 35M - 4400M
-  if(Freq<35e6 || Freq > 4400e6)// 32-bit high limit at 4295M
+  if(hop.Running())
   {
-    scpi.PushError((char *)"Frequency out of range");
-    return 1; // comment just this line to check for frequencies unlocking the PLL
-  }  
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
 
-  //uint64_t iFreq = (uint64_t)Freq;
-  if(sigGen.SetFreq(Freq))
+  if(count<numChans.min || count>numChans.max || hopStart+(count-1)*hopSpacing>(uint64_t)numFreq.max)
   {
-    scpi.PushError((char *)"Uncomputable Frequency");
+    scpi.PushError(ERR_DATA_RANGE);
     return 1;
-  };
-  currFreq=Freq;
+  }
+
+  hop.Clear();
+  hop.Modulus=sHOP::GridModulus(sigGen.RefPFD(),hopSpacing);
+  for(c=0;c<count;c++)
+    if(hop.AddChannel(&sigGen,hopStart+c*hopSpacing)<0)
+    {
+      hop.Clear();
+      scpi.PushError(ERR_UNCOMPUTABLE);
+      return 1;
+    }
   return 0;
 }
 
-
-uint32_t RFPower(double pwr, bool qry)
+// Hop sequence, channel numbers as comma separated values
+uint32_t HopSequence(int64_t channel, bool qry)
 {
+  if(!SweepChannel())
+    return 1;
+
   if(qry)
   {
-    Serial.println(currPwr);
-    return 0;    
+    resp.Uint(hop.Hops());
+    return 0;
   }
 
-#ifdef DEBUG
-Serial.print("Set Power @ ");Serial.println(pwr);
-#endif
-  if(pwr>5 || pwr<-4)
+  if(hop.Running())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
+
+  if(scpi.ArgIndex()==0)
+    hop.ClearHops();
+
+  if(channel<0 || channel>255 || !hop.AddHop(channel))
   {
-    scpi.PushError((char *)"Power out of range");
+    scpi.PushError(ERR_DATA_RANGE);
     return 1;
   }
-  sigGen.SetPower(pwr);
-  currPwr=pwr;
   return 0;
 }
 
-
-// Enable or disable RF output
-// Parameter is 1 for enable and 0 for disable
-uint32_t SetRFOut(double rfout, bool qry)
+uint32_t HopLength(int64_t len, bool qry)
 {
-  bool brfout = (bool)rfout;
-  
-  sigGen.SetOut(brfout);
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hopLength);
+    return 0;
+  }
+
+  if(len<numHopLen.min || len>numHopLen.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  hopLength=len;
   return 0;
 }
 
+// Pseudo-random sequence of LENGth hops over all channels, from a seed.
+// Read, the seed of the last one
+uint32_t HopRandom(int64_t seed, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hopSeed);
+    return 0;
+  }
 
+  if(hop.Running())
+  {
+    scpi.PushError(ERR_SETTINGS_CONFLICT);
+    return 1;
+  }
 
-#if 0
-// Start or stop a sweep operation
-// Parameter is 1 for start and 0 for stop 
-void Sweep(double startSweep)
-{
-  if (startSweep > 0)
+  if(!hop.Random((uint32_t)seed,hopLength))
   {
-    sweeping = true;
-    sweepCurrentf_kHz = sweepStartf_kHz;
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
   }
-  else
-    sweeping = false;
+  hopSeed=seed;
+  return 0;
 }
 
+// Time per hop, in seconds, read in us
+uint32_t HopDwell(int64_t dwell, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Fixed(hopDwell_us,6);
+    return 0;
+  }
+
+  if(dwell<numHopDwel.min || dwell>numHopDwel.max)
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  hopDwell_us=dwell;
+  return 0;
+}
 
-// Set the start f_kHzuency used for sweeping
-// Parameter is the f_kHzuency in Hz
-void SetSweepStart(double f_kHzStart)
+// Pulse on HOP_SYNC_PIN at every hop
+uint32_t HopSync(int64_t on, bool qry)
 {
-  sweepStartf_kHz = f_kHzStart;
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hopSync ? 1 : 0);
+    return 0;
+  }
+
+  hopSync=on!=0;
+  return 0;
 }
 
+uint32_t HopState(int64_t on, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hop.Running() ? 1 : 0);
+    return 0;
+  }
+
+  if(!on)
+  {
+    if(hop.Running())
+    {
+      hop.Stop();
+      RunStatus();
+      sigGen.SetFreq(currFreq[0]);   // back to CW
+    }
+    return 0;
+  }
+
+  sweep.Stop();
+  RunStatus();
+  if(!hop.Start(&sigGen,hopDwell_us,hopSync))
+  {
+    scpi.PushError(ERR_DATA_RANGE);
+    return 1;
+  }
+  RunStatus();
+  return 0;
+}
 
-// Set the stop f_kHzuency used for sweeping
-// Parameter is the f_kHzuency in Hz
-void SetSweepStop(double f_kHzStop)
+// Measured hop rate, in hops per second
+uint32_t HopRate(int64_t na, bool qry)
 {
-  sweepStopf_kHz = f_kHzStop;
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hop.Rate());
+    return 0;
+  }
+
+  return 1;
 }
-#endif
 
+// Hops sent a dwell or more late
+uint32_t HopMissed(int64_t na, bool qry)
+{
+  if(!SweepChannel())
+    return 1;
+
+  if(qry)
+  {
+    resp.Uint(hop.Missed);
+    return 0;
+  }
 
+  return 1;
+}
 
-uint32_t GetIDN(double, bool qry)
+// Hops in the sequence that are R0 only, and full reprograms
+uint32_t HopClass(int64_t na, bool qry)
 {
+  if(!SweepChannel())
+    return 1;
+
   if(qry)
   {
-    Serial.println("Mojon City,RFG4000,230001,1.0");
+    resp.Uint(hop.R0Only);
+    resp.Uint(hop.Full);
     return 0;
   }
 
   return 1;
 }
 
-// Perform RST
-uint32_t DoRST(double na, bool qry)
+// Binary frames --------------------------------------------------------------
+uint8_t BinFreq(uint64_t freq)
 {
-#ifdef DEBUG
-  Serial.println("dbg: RST !!");
-#endif
-  InitParms();
+  if(TimedRun() || freq<(uint64_t)numFreq.min || freq>(uint64_t)numFreq.max)
+    return 1;
+  if(sigGen.SetFreq(freq))
+    return 1;
+  currFreq[0]=freq;
   return 0;
 }
 
-// Read the ERROR pool
-uint32_t SysError(double na, bool qry)
+uint8_t BinReg(uint64_t word)
+{
+  if(TimedRun())
+    return 1;
+  return sigGen.SetREG((uint32_t)word);
+}
+
+uint8_t BinOut(uint64_t on)
 {
-char text[32];
+  return TuneOut(0,on!=0);
+}
 
+// Binary frames: done and refused
+uint32_t BinStats(int64_t na, bool qry)
+{
   if(qry)
   {
-    scpi.PullError(text);
-    Serial.println(text);
+    resp.Uint(bin.Frames);
+    resp.Uint(bin.Errors);
     return 0;
   }
 
-  //push error ?
   return 1;
 }
 
-uint32_t Impedance(double na, bool qry)
+// Lock time, R0 write to LD rising, by RF divider 1,2,4..64:
+// count,min,mean,max in us for each, 0,0,0,0 when never seen
+uint32_t LockTimes(int64_t na, bool qry)
 {
+LockStat stat[7];
+uint32_t unlocks;
+int c,ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
   if(qry)
   {
-    Serial.println("50");
+    synth[ch]->GetLockStats(stat,&unlocks);
+    for(c=0;c<7;c++)
+    {
+      resp.Uint(stat[c].Count);
+      resp.Uint(stat[c].Count ? stat[c].Min_us : 0);
+      resp.Uint(stat[c].Count ? stat[c].Sum_us/stat[c].Count : 0);
+      resp.Uint(stat[c].Max_us);
+    }
     return 0;
   }
 
-  //push error ?
   return 1;
 }
 
-uint32_t GetAdjRefOsc(double na, bool qry)
+// Times LD fell on its own, not after a retune
+uint32_t LockUnlocks(int64_t na, bool qry)
 {
-    Serial.println(currROsc);
+LockStat stat[7];
+uint32_t unlocks;
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  if(qry)
+  {
+    synth[ch]->GetLockStats(stat,&unlocks);
+    resp.Uint(unlocks);
     return 0;
+  }
+
+  return 1;
+}
+
+uint32_t LockClear(int64_t na, bool qry)
+{
+int ch;
+
+  ch = Channel();
+  if(ch<0)
+    return 1;
+
+  synth[ch]->ClearLockStats();
+  return 0;
 }
 
-uint32_t AdjRefOsc(double errHz, bool qry)
+// Longest loop() pass, in us, since last asked, and replies that found
+// the TX ring full (sRESP.h)
+uint32_t LoopStats(int64_t na, bool qry)
 {
   if(qry)
   {
-    Serial.println(currROsc);
+    resp.Uint(taskPassMax_us);
+    resp.Uint(resp.Stalls);
+    taskPassMax_us=0;
     return 0;
   }
 
-  sigGen.REFin_Err = errHz;
-  currROsc=errHz;
-  return 0;
+  return 1;
+}
+
+// Tasks ------------------------------------------------------------------------
+// PLL lock supervision: unlocked for LOCK_GRACE_MS is an error, once per
+// channel
+void LockTask(void)
+{
+int c;
+
+  for(c=0;c<CHANNELS;c++)
+  {
+    // hopping relocks every dwell, lock times are in DIAG:LOCK:TIME?
+    if(synth[c]->FreqLocked() || (c==0 && hop.Running()))
+    {
+      serrFLOCK[c]=0;
+      unlockSince[c]=0;
+      continue;
+    }
+
+    if(serrFLOCK[c])
+      continue;
+    if(!unlockSince[c])
+      unlockSince[c]=millis()|1;
+    else if(millis()-unlockSince[c] >= LOCK_GRACE_MS)
+    {
+      serrFLOCK[c]=1;
+      scpi.PushError(ERR_PLL_UNLOCK, 0);
+      noInterrupts();
+      chUnlocked |= 1<<c;
+      LockStatusLocked();
+      interrupts();
+    }
+  }
+}
+
+// *OPC armed: operation complete once nothing is settling
+void OpcTask(void)
+{
+  if(!opcArmed)
+    return;
+
+  if(Settling())
+  {
+    if(millis()-opcSince < OPC_TIMEOUT_MS)
+      return;
+    OpcExpire(0);
+  }
+  opcArmed = 0;
+  status.Event(ESR_OPC);
+  Trace(TRACE_CMD, TR_OPC, millis()-opcSince);
+}
+
+// let's blink the LED; of course!
+void HeartbeatTask(void)
+{
+  if(++heartbeat==10)
+    heartbeat=0;
+  digitalWrite(LED_BUILTIN, heartbeat ? LOW : HIGH);
 }
 
-void InitParms(void)
+// Defaults; the first synth is left alone unless tune, the others aren't
+// saved and always go back to them
+void InitParms(bool tune)
 {
-  currPwr=D_PWR;
+int c;
+
+  sweep.Stop();
+  hop.Stop();
+  hop.Clear();
+  RunStatus();
+  hopStart=D_SWE_STAR;
+  hopSpacing=numSpacing.def;
+  hopLength=D_HOP_LEN;
+  hopSeed=0;
+  hopDwell_us=D_HOP_DWEL;
+  hopSync=0;
+  opcArmed=0;
+  sweepStart=D_SWE_STAR;
+  sweepStop=D_SWE_STOP;
+  sweepPoints=D_SWE_POIN;
+  sweepDwell_us=D_SWE_DWEL;
+  listPoints=0;
+
   currROsc=D_ROSC;
-  currFreq=D_FREQ; 
-  
+  for(c=0;c<CHANNELS;c++)
+  {
+    currPwr[c]=D_PWR;
+    currFreq[c]=D_FREQ; 
+    currOut[c]=0;
+  }
+
+  for(c=1;c<CHANNELS;c++)
+  {
+    synth[c]->REFin_Err = D_ROSC;
+    TuneFreq(c,currFreq[c]);
+    if(D_OUT)
+      TuneOut(c,1);
+  }
+  if(tune)
+    TuneDefault();
+}
+
+// First synth to the defaults InitParms() left in currFreq etc.
+void TuneDefault(void)
+{
   AdjRefOsc(D_ROSC,0);
-  CenterFrequency(currFreq,0);
+  TuneFreq(0,currFreq[0]);
   if(D_OUT)
-    SetRFOut(1,0);
-
+    TuneOut(0,1);
 }
 
 // ========================================================================================== Initialize
 void setup() 
 {
+int n;
+
   Serial.begin(115200);
 #ifdef DEBUG  
   while(!Serial);
 #endif
 
-  serrFLOCK = 0;
+  for(n=0;n<CHANNELS;n++)
+  {
+    serrFLOCK[n] = 0;
+    unlockSince[n] = 0;
+  }
   OOK=0;
   heartbeat=0;
+  pinMode(LED_BUILTIN, OUTPUT);
+  Trace(TRACE_ERR, TR_BOOT);
 
 #ifdef DEBUG
 Serial.println("\n\r\r\r\r\r\r\r============================================== SigGen4000 STARTING");
@@ -281,76 +1753,139 @@ Serial.println("ARM_MATH_CM0PLUS is defined");
   uint8_t grpIDN = scpi.CreateGroup((char *)"*", 0);  // ------------------------- Standard Subsystem 
   scpi.RegisterParameter((char *)"IDN", grpIDN, &GetIDN);
   scpi.RegisterParameter((char *)"RST", grpIDN, &DoRST);
-  //scpi.RegisterParameter((char *)"SAV", grpIDN, &WriteEE);
-  //scpi.RegisterParameter((char *)"RCL", grpIDN, &ReadEE);
+  scpi.RegisterParameter((char *)"SAV", grpIDN, &SaveSlot);
+  scpi.RegisterParameter((char *)"RCL", grpIDN, &RecallSlot);
+  scpi.RegisterParameter((char *)"OPC", grpIDN, &OpcCmd);
+  scpi.RegisterParameter((char *)"WAI", grpIDN, &WaiCmd);
+  scpi.RegisterParameter((char *)"CLS", grpIDN, &ClearStatus);
+  scpi.RegisterParameter((char *)"ESE", grpIDN, &EventEnable, &numByte);
+  scpi.RegisterParameter((char *)"ESR", grpIDN, &EventStatus);
+  scpi.RegisterParameter((char *)"SRE", grpIDN, &ServiceEnable, &numByte);
+  scpi.RegisterParameter((char *)"STB", grpIDN, &StatusByte);
   
-  uint8_t grpOutput = scpi.CreateGroup((char *)"OUTP", 0);  // ------------------------- OUTPut Subsystem 
+  uint8_t grpOutput = scpi.CreateGroup((char *)"OUTPut", 0);  // ------------------------- OUTPut Subsystem 
   scpi.RegisterParameter((char *)"", grpOutput, &SetRFOut);
-  scpi.RegisterParameter((char *)"IMP", grpOutput, &Impedance);
+  scpi.RegisterParameter((char *)"IMPedance", grpOutput, &Impedance);
 
-  uint8_t grpSystem = scpi.CreateGroup((char *)"SYST", 0); // ------------------------- SYSTem Subsystem
-  scpi.RegisterParameter((char *)"ERR", grpSystem, &SysError);
-  scpi.RegisterParameter((char *)"PRES", grpSystem, &DoRST);
+  uint8_t grpSystem = scpi.CreateGroup((char *)"SYSTem", 0); // ------------------------- SYSTem Subsystem
+  scpi.RegisterParameter((char *)"ERRor[:NEXT]", grpSystem, &SysError);
+  scpi.RegisterParameter((char *)"PRESet", grpSystem, &DoRST);
   scpi.RegisterParameter((char *)"PON:TYPE", grpSystem, &DoRST);
+  scpi.RegisterParameter((char *)"TRACe:DATA", grpSystem, &TraceData);
+  scpi.RegisterParameter((char *)"TRACe:MASK", grpSystem, &TraceMask, &numTrMask);
 
-  uint8_t grpSource = scpi.CreateGroup((char *)"SOUR", 0); // ------------------------- SOURce Subsystem
-  scpi.RegisterParameter((char *)"FREQ", grpSource, &CenterFrequency);
-  scpi.RegisterParameter((char *)"FREQ:CW", grpSource, &CenterFrequency);
-  scpi.RegisterParameter((char *)"POW", grpSource, &RFPower);
+  uint8_t grpStatus = scpi.CreateGroup((char *)"STATus", 0); // ------------------------- STATus Subsystem
+  scpi.RegisterParameter((char *)"OPERation[:EVENt]", grpStatus, &OperEvent);
+  scpi.RegisterParameter((char *)"OPERation:CONDition", grpStatus, &OperCond);
+  scpi.RegisterParameter((char *)"OPERation:ENABle", grpStatus, &OperEnable, &numStatEn);
+  scpi.RegisterParameter((char *)"QUEStionable[:EVENt]", grpStatus, &QuesEvent);
+  scpi.RegisterParameter((char *)"QUEStionable:CONDition", grpStatus, &QuesCond);
+  scpi.RegisterParameter((char *)"QUEStionable:ENABle", grpStatus, &QuesEnable, &numStatEn);
+  scpi.RegisterParameter((char *)"PRESet", grpStatus, &StatusPreset);
 
-  uint8_t grpRefOsc = scpi.CreateGroup((char *)"ROSC", grpSource);
-  scpi.RegisterParameter((char *)"ADJ:VAL", grpRefOsc, &AdjRefOsc);
+  uint8_t grpSource = scpi.CreateGroup((char *)"[SOURce]", 0); // ------------------------- SOURce Subsystem
+  scpi.RegisterParameter((char *)"FREQuency[:CW]", grpSource, &CenterFrequency, &numFreq);
+  scpi.RegisterParameter((char *)"POWer[:LEVel]", grpSource, &RFPower, &numPower);
+  scpi.RegisterParameter((char *)"FREQuency:STARt", grpSource, &SweepStart, &numStart);
+  scpi.RegisterParameter((char *)"FREQuency:STOP", grpSource, &SweepStop, &numStop);
+  scpi.RegisterParameter((char *)"FREQuency:ALL", grpSource, &AllFrequency, &numFreq);
+  scpi.RegisterParameter((char *)"FREQuency:PLAN", grpSource, &FreqPlan);
+  scpi.RegisterParameter((char *)"PLL:FAST", grpSource, &FastSettle);
+  scpi.RegisterParameter((char *)"PLL:OPTimize", grpSource, &PlanOptimize);
+  scpi.RegisterParameter((char *)"PLL:LOCK", grpSource, &PLLLocked);
 
-  // ---------------------------- Initialize SYNTH
-  sigGen.Init();
+  uint8_t grpSweep = scpi.CreateGroup((char *)"SWEep", grpSource); // ------------------------- SWEep Subsystem
+  scpi.RegisterParameter((char *)"POINts", grpSweep, &SweepPoints, &numPoints);
+  scpi.RegisterParameter((char *)"STEP", grpSweep, &SweepStep, &numStep);
+  scpi.RegisterParameter((char *)"DWELl", grpSweep, &SweepDwell, &numDwell);
+  scpi.RegisterParameter((char *)"STATe", grpSweep, &SweepState);
+  scpi.RegisterParameter((char *)"RATE", grpSweep, &SweepRate);
 
-  // ---------------------------- Read stored config
-  //ReadEE();
+  uint8_t grpList = scpi.CreateGroup((char *)"LIST", grpSource); // ------------------------- LIST Subsystem
+  scpi.RegisterParameter((char *)"FREQuency", grpList, &ListFreq, &numFreq);
+  scpi.RegisterParameter((char *)"REGister", grpList, &ListRegs);
+  scpi.RegisterParameter((char *)"STATe", grpList, &ListState);
 
-  // ---------------------------- or, set default config
-  InitParms();
+  uint8_t grpHop = scpi.CreateGroup((char *)"HOP", grpSource); // ------------------------- HOP Subsystem
+  scpi.RegisterParameter((char *)"CHANnel[:LIST]", grpHop, &HopChannels, &numFreq);
+  scpi.RegisterParameter((char *)"CHANnel:STARt", grpHop, &HopChanStart, &numFreq);
+  scpi.RegisterParameter((char *)"CHANnel:SPACing", grpHop, &HopChanSpacing, &numSpacing);
+  scpi.RegisterParameter((char *)"CHANnel:COUNt", grpHop, &HopChanCount, &numChans);
+  scpi.RegisterParameter((char *)"SEQuence[:LIST]", grpHop, &HopSequence);
+  scpi.RegisterParameter((char *)"SEQuence:LENGth", grpHop, &HopLength, &numHopLen);
+  scpi.RegisterParameter((char *)"SEQuence:RANDom", grpHop, &HopRandom);
+  scpi.RegisterParameter((char *)"DWELl", grpHop, &HopDwell, &numHopDwel);
+  scpi.RegisterParameter((char *)"SYNC", grpHop, &HopSync);
+  scpi.RegisterParameter((char *)"STATe", grpHop, &HopState);
+  scpi.RegisterParameter((char *)"RATE", grpHop, &HopRate);
+  scpi.RegisterParameter((char *)"MISSed", grpHop, &HopMissed);
+  scpi.RegisterParameter((char *)"CLASs", grpHop, &HopClass);
+
+  uint8_t grpRefOsc = scpi.CreateGroup((char *)"ROSCillator", grpSource);
+  scpi.RegisterParameter((char *)"ADJust:VALue", grpRefOsc, &AdjRefOsc, &numROsc);
+
+  uint8_t grpDiag = scpi.CreateGroup((char *)"DIAGnostic", 0); // ------------------------- DIAGnostic Subsystem
+  scpi.RegisterParameter((char *)"BENChmark", grpDiag, &Benchmark);
+  scpi.RegisterParameter((char *)"SPI", grpDiag, &SPIStats);
+  scpi.RegisterParameter((char *)"CACHe", grpDiag, &CacheStats);
+  scpi.RegisterParameter((char *)"BINary", grpDiag, &BinStats);
+  scpi.RegisterParameter((char *)"LOOP", grpDiag, &LoopStats);
+  scpi.RegisterParameter((char *)"LOCK:TIME", grpDiag, &LockTimes);
+  scpi.RegisterParameter((char *)"LOCK:UNLocks", grpDiag, &LockUnlocks);
+  scpi.RegisterParameter((char *)"LOCK:CLEar", grpDiag, &LockClear);
+
+  // ---------------------------- Binary frames
+  bin.Register(BIN_OP_FREQ, &BinFreq);
+  bin.Register(BIN_OP_REG, &BinReg);
+  bin.Register(BIN_OP_OUT, &BinOut);
+
+  // ---------------------------- Tasks run from loop()
+  TaskAdd(&LockTask, 1000);
+  TaskAdd(&OpcTask, 0);
+  TaskAdd(&HeartbeatTask, HEARTBEAT_MS*1000UL);
+  TaskAdd(&TimerService, 0);        // polled timer, on cores without the hardware one
+
+  // ---------------------------- Initialize SYNTH
+  ADF4351::LockHook = &LockEvent;
+  for(n=0;n<CHANNELS;n++)
+  {
+    synth[n]->Init();
+    noInterrupts();
+    if(synth[n]->FreqLocked())
+      chLocked |= 1<<n;
+    interrupts();
+  }
+  LockStatus();
+
+  // ---------------------------- Read stored config, slot 0
+  store.Begin();
+  // slot 0 as saved, or the defaults if it's missing or from another layout
+  InitParms(0);
+  if(!RecallState(0))
+    TuneDefault();
 
 }
 
 // ============================================================================================ Main loop
 void loop() 
 {
-  // command input check -----------------------
-  if (Serial.available() > 0)
-    scpi.Parse(Serial.read());
-
-  // PLL lock check ----------------------------
-  if(sigGen.FreqLocked()!=true)
-  {
-    if(serrFLOCK==0)
-    {
-      delay(4);
-      if(sigGen.FreqLocked()!=true)
-      {
-          serrFLOCK=1;
-          scpi.PushError((char *)"PLL Unlock");
-      }
-    }
-  }
-  else
-  {
-    serrFLOCK=0;
-  }
+int n;
 
-#if 0  
-  // sweep state operation --------------------
-  if (sweeping)
+  // command input: all of it, every pass -----
+  for(n=Serial.available();n>0;n--)
   {
-    sweepCurrentf_kHz += sweepStep;
-    
-    if (sweepCurrentf_kHz < sweepStopf_kHz)
-    {
-      SetCenterFrequency(sweepCurrentf_kHz);
-    }
+    uint8_t c = Serial.read();
+    if(bin.Busy() || c==BIN_SYNC)
+      bin.Parse(c);
     else
-      sweepCurrentf_kHz = sweepStartf_kHz;
+      scpi.Parse(c);
   }
-#endif
+
+  // lock check, LED, polled timer --------------
+  TaskRun();
+
+  // replies, what the port takes ---------------
+  resp.Drain();
 
 #if 0
   // OOK operation -------------------------
@@ -365,16 +1900,4 @@ void loop()
 
 #endif
 
-  // let's blink the LED; of course!
-  if(++heartbeat==10000)
-  {
-    digitalWrite(LED_BUILTIN, LOW);
-  }
-  if(heartbeat==300000)
-  {
-    digitalWrite(LED_BUILTIN, HIGH);
-    heartbeat=0;
-  }
-
-
 }
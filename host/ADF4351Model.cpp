@@ -0,0 +1,238 @@
+/*------------------------------------------------------------------------------*\
+ADF4351 behavioral model, for the host build
+(c,2003 luis-es)
+\*------------------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPI.h"
+#include "ADF4351Model.h"
+
+ADF4351Model adfModel;
+ADF4351Model adfModel2;
+
+ADF4351Model *ADF4351Model::Models[MODEL_MAX];
+uint8_t ADF4351Model::Count;
+
+// shared clock and data: every chip shifts in every byte
+static uint8_t modelShift(uint8_t mosi)
+{
+uint8_t i;
+
+  for(i=0;i<ADF4351Model::Count;i++)
+    ADF4351Model::Models[i]->Shift(mosi);
+  return 0;
+}
+
+static void modelLE(uint8_t pin, uint8_t level)
+{
+ADF4351Model *m;
+
+  m = ADF4351Model::OnPin(pin);
+  if(m)
+    m->LE(level);
+}
+
+static uint8_t modelLD(uint8_t pin)
+{
+ADF4351Model *m;
+
+  m = ADF4351Model::OnPin(pin);
+  return m ? m->LD() : LOW;
+}
+
+/* Public Functions =============================================================*/
+
+void ADF4351Model::Attach(uint8_t lePin, uint8_t ldPin)
+{
+int c;
+
+  if(REFin==0)
+    REFin = 25000000;
+  if(LockTime_us==0)
+    LockTime_us = 200;
+
+  for(c=0;c<6;c++)
+  {
+    Reg[c] = c;
+    Active[c] = c;
+    Writes[c] = 0;
+  }
+  Shifter = 0;
+  Bits = 0;
+  LELevel = HIGH;
+  LockAt = 0;
+  LePin = lePin;
+  LdPin = ldPin;
+
+  for(Id=0;Id<Count && Models[Id]!=this;Id++)
+    ;
+  if(Id==Count && Count<MODEL_MAX)
+    Models[Count++] = this;
+
+  HostSPIHook(modelShift);
+  HostPinHook(lePin, modelLE, NULL);
+  HostPinHook(ldPin, NULL, modelLD);
+}
+
+ADF4351Model *ADF4351Model::OnPin(uint8_t pin)
+{
+uint8_t i;
+
+  for(i=0;i<Count;i++)
+    if(Models[i]->LePin==pin || Models[i]->LdPin==pin)
+      return Models[i];
+  return NULL;
+}
+
+double ADF4351Model::PFD(void)
+{
+uint32_t r2;
+double r;
+
+  r2 = Active[2];
+  r = (r2>>14) & 0x3FF;
+  if(r==0)
+    return 0;
+
+  return REFin * ((r2>>25 & 1) ? 2.0 : 1.0) / (r * ((r2>>24 & 1) ? 2.0 : 1.0));
+}
+
+double ADF4351Model::VCO(void)
+{
+double n,mod;
+uint8_t div;
+
+  mod = (Active[1]>>3) & 0xFFF;
+  n = (Active[0]>>15) & 0xFFFF;
+  if(mod>0)
+    n += ((Active[0]>>3) & 0xFFF) / mod;
+
+  div = (Active[4]>>20) & 7;
+  if(Active[4]>>23 & 1)
+    return n * PFD();                 // feedback from the VCO
+  return n * PFD() * (1<<div);        // feedback from the divided output
+}
+
+double ADF4351Model::Output(void)
+{
+uint32_t r4;
+
+  r4 = Active[4];
+  if(!(r4>>5 & 1) || (r4>>11 & 1))    // RF out disabled, VCO powered down
+    return 0;
+  if((r4>>10 & 1) && !Locked())       // muted till lock detect
+    return 0;
+
+  return VCO() / (1<<((r4>>20) & 7));
+}
+
+bool ADF4351Model::Locked(void)
+{
+double vco;
+
+  switch((Active[5]>>22) & 3)
+  {
+    case 1:
+      break;          // digital lock detect
+    case 3:
+      return 1;
+    default:
+      return 0;
+  }
+
+  if(!Writes[0] || (Active[2]>>5 & 1))  // never programmed, powered down
+    return 0;
+
+  vco = VCO();
+  if(vco<2.2e9 || vco>4.4e9)
+    return 0;
+
+  return (int32_t)(micros() - LockAt) >= 0;
+}
+
+uint8_t ADF4351Model::Shift(uint8_t mosi)
+{
+  Shifter = Shifter<<8 | mosi;
+  Bits += 8;
+  return 0;
+}
+
+void ADF4351Model::LE(uint8_t level)
+{
+  if(level && !LELevel && Bits>=32)
+    Latch(Shifter);
+  if(!level)
+    Bits = 0;
+  LELevel = level;
+}
+
+uint8_t ADF4351Model::LD(void)
+{
+  return Locked() ? HIGH : LOW;
+}
+
+/* Private Functions ============================================================*/
+
+void ADF4351Model::Latch(uint32_t word)
+{
+uint32_t now;
+uint8_t n;
+
+  // reading the time runs the pin interrupts: do it before any change
+  now = micros();
+  n = word & 7;
+  if(n>5)
+    return;             // 8V97051 only registers
+
+  Reg[n] = word;
+  Writes[n]++;
+
+  switch(n)
+  {
+    case 0:
+      // R0 loads the double buffers and starts a new lock
+      Active[0] = word;
+      Active[1] = Reg[1];
+      Active[2] = Reg[2];
+      Active[4] = Reg[4];
+      LockAt = now + LockDelay_us();
+      break;
+    case 4:
+      if(Active[2]>>13 & 1)
+        Active[4] = (word & ~0x00700000) | (Active[4] & 0x00700000);
+      else
+        Active[4] = word;
+      break;
+    case 3:
+    case 5:
+      Active[n] = word;
+      break;
+    default:
+      break;            // R1, R2 wait for R0
+  }
+
+  if(Trace)
+  {
+    if(Id)
+      fprintf(stderr,"[adf%u] ",Id+1);
+    else
+      fprintf(stderr,"[adf] ");
+    fprintf(stderr,"R%u=%08X  fOUT=%.3f Hz\n",n,word,VCO()/(1<<((Active[4]>>20) & 7)));
+  }
+}
+
+uint32_t ADF4351Model::LockDelay_us(void)
+{
+uint32_t bsdiv,settle;
+double pfd;
+
+  pfd = PFD();
+  bsdiv = (Active[4]>>12) & 0xFF;
+  if(pfd<=0 || bsdiv==0)
+    return LockTime_us;
+
+  settle = LockTime_us;
+  if(((Active[3]>>15) & 3)==1 && ((Active[3]>>3) & 0xFFF))
+    settle /= 4;
+
+  return (uint32_t)(10e6*bsdiv/pfd) + settle;
+}
@@ -0,0 +1,73 @@
+/*------------------------------------------------------------------------------*\
+ADF4351 behavioral model, for the host build
+(c,2003 luis-es)
+
+  Register level: bytes are shifted in MSB first while LE is low, and
+  the last 32 bits are latched on the LE rising edge into the register
+  named by their 3 control bits, as the chip does.
+
+  R1 and R2 (and R4 RF divider select, when R2 double buffer is on) only
+  take effect on the next R0 write. Every R0 write restarts the lock:
+  LD goes low and rises again, if the VCO is within range, after
+
+    VCO band selection, about 10 band select clocks (R4 divider), plus
+    LockTime_us, or a fourth of it when the R3 fast lock timer is on
+
+  A rough stand-in for the loop: 16 times the charge pump current is 4
+  times the bandwidth. Cycle slip reduction isn't modeled.
+
+  Several models can share the bus, as chips do: each one shifts in
+  every byte and latches on its own LE pin.
+\*------------------------------------------------------------------------------*/
+#ifndef _ADF4351MODEL_H
+#define _ADF4351MODEL_H
+
+#include <stdint.h>
+
+#define MODEL_MAX 4
+
+class ADF4351Model
+{
+	public:
+		// Hook the model to the host SPI and to the LE/LD pins
+		void Attach(uint8_t lePin, uint8_t ldPin);
+		// Model on an LE or LD pin, NULL if none
+		static ADF4351Model *OnPin(uint8_t pin);
+		static ADF4351Model *Models[MODEL_MAX];
+		static uint8_t Count;
+
+		uint32_t REFin;           // Hz
+		uint32_t LockTime_us;     // loop settling, after band selection
+		bool Trace;               // print every latched word to stderr
+
+		uint32_t Reg[6];          // as written
+		uint32_t Writes[6];       // words latched, per register
+
+		// Decoded from the active (latched by R0) settings
+		double PFD(void);
+		double VCO(void);
+		double Output(void);      // 0 when RF out is off or muted
+		bool Locked(void);
+
+		// SPI and pin callbacks
+		uint8_t Shift(uint8_t mosi);
+		void LE(uint8_t level);
+		uint8_t LD(void);
+
+	private:
+		uint8_t Id;               // order of Attach(), 0 first
+		uint8_t LePin,LdPin;
+		uint32_t Active[6];       // registers in effect
+		uint32_t Shifter;
+		uint8_t Bits;
+		uint8_t LELevel;
+		uint32_t LockAt;
+
+		void Latch(uint32_t word);
+		uint32_t LockDelay_us(void);
+};
+
+extern ADF4351Model adfModel;     // the first chip
+extern ADF4351Model adfModel2;
+
+#endif
@@ -0,0 +1,476 @@
+/*------------------------------------------------------------------------------*\
+Host stand-in for the Arduino core
+(c,2003 luis-es)
+\*------------------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPI.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+HostSerial Serial;
+SPIClass SPI;
+
+/* GPIO =========================================================================*/
+
+static uint8_t pinLevel[HOST_PINS];
+static host_pin_write_t pinWrite[HOST_PINS];
+static host_pin_read_t pinRead[HOST_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if(pin<HOST_PINS && mode==INPUT_PULLUP)
+    pinLevel[pin]=HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if(pin>=HOST_PINS)
+    return;
+
+  pinLevel[pin]=val ? HIGH : LOW;
+  if(pinWrite[pin])
+    pinWrite[pin](pin,pinLevel[pin]);
+}
+
+int digitalRead(uint8_t pin)
+{
+  if(pin>=HOST_PINS)
+    return LOW;
+
+  if(pinRead[pin])
+    return pinRead[pin](pin);
+  return pinLevel[pin];
+}
+
+void HostPinHook(uint8_t pin, host_pin_write_t write, host_pin_read_t read)
+{
+  if(pin>=HOST_PINS)
+    return;
+
+  pinWrite[pin]=write;
+  pinRead[pin]=read;
+}
+
+/* Time =========================================================================*/
+
+static uint64_t nowNs(void)
+{
+struct timespec ts;
+static uint64_t t0;
+uint64_t t;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  t=(uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+  if(t0==0)
+    t0=t;
+  return t-t0;
+}
+
+unsigned long millis(void)
+{
+  HostInterrupts();
+  return (uint32_t)(nowNs()/1000000);
+}
+
+unsigned long micros(void)
+{
+  HostInterrupts();
+  return (uint32_t)(nowNs()/1000);
+}
+
+uint32_t HostNanos(void)
+{
+  return (uint32_t)nowNs();
+}
+
+void delay(unsigned long ms)
+{
+  usleep(ms*1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  usleep(us);
+}
+
+/* Interrupts ===================================================================*/
+
+// single threaded: interrupts are only ever simulated from the main flow
+void noInterrupts(void)
+{
+}
+
+void interrupts(void)
+{
+}
+
+static void (*pinIsr[HOST_PINS])(void);
+static uint8_t pinIsrMode[HOST_PINS];
+static uint8_t pinIsrLevel[HOST_PINS];
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+  if(pin>=HOST_PINS)
+    return;
+
+  pinIsrLevel[pin]=digitalRead(pin);
+  pinIsrMode[pin]=mode;
+  pinIsr[pin]=isr;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  if(pin<HOST_PINS)
+    pinIsr[pin]=0;
+}
+
+void HostInterrupts(void)
+{
+static bool busy;
+uint8_t pin,level;
+
+  // handlers and pin models read the time too
+  if(busy)
+    return;
+  busy=1;
+
+  for(pin=0;pin<HOST_PINS;pin++)
+  {
+    if(!pinIsr[pin])
+      continue;
+
+    level=digitalRead(pin);
+    if(level==pinIsrLevel[pin])
+      continue;
+    pinIsrLevel[pin]=level;
+
+    if(pinIsrMode[pin]==CHANGE || (pinIsrMode[pin]==RISING && level) ||
+      (pinIsrMode[pin]==FALLING && !level))
+      pinIsr[pin]();
+  }
+
+  busy=0;
+}
+
+/* Flash ========================================================================*/
+
+static uint8_t flashMem[HOST_FLASH_SIZE];
+static bool flashReady;
+static FILE *flashFile;
+
+static void flashInit(void)
+{
+  if(flashReady)
+    return;
+  memset(flashMem,0xFF,sizeof(flashMem));
+  flashReady=1;
+}
+
+// keep the file in step with flashMem[addr..addr+len)
+static void flashSync(uint32_t addr, uint32_t len)
+{
+  if(!flashFile)
+    return;
+  fseek(flashFile,addr,SEEK_SET);
+  fwrite(&flashMem[addr],1,len,flashFile);
+  fflush(flashFile);
+}
+
+void HostFlashFile(const char *path)
+{
+  flashInit();
+  flashFile=fopen(path,"r+b");
+  if(flashFile)
+  {
+    if(fread(flashMem,1,sizeof(flashMem),flashFile)==sizeof(flashMem))
+      return;
+    fclose(flashFile);    // short, start over blank
+  }
+
+  memset(flashMem,0xFF,sizeof(flashMem));
+  flashFile=fopen(path,"w+b");
+  flashSync(0,sizeof(flashMem));
+}
+
+void HostFlashRead(uint32_t addr, void *data, uint32_t len)
+{
+  flashInit();
+  if(addr+len>sizeof(flashMem))
+    return;
+  memcpy(data,&flashMem[addr],len);
+}
+
+void HostFlashErase(uint32_t addr, uint32_t len)
+{
+  flashInit();
+  if(addr+len>sizeof(flashMem))
+    return;
+  memset(&flashMem[addr],0xFF,len);
+  flashSync(addr,len);
+}
+
+void HostFlashWrite(uint32_t addr, const void *data, uint32_t len)
+{
+uint32_t n;
+
+  flashInit();
+  if(addr+len>sizeof(flashMem))
+    return;
+  for(n=0;n<len;n++)
+    flashMem[addr+n] &= ((const uint8_t *)data)[n];
+  flashSync(addr,len);
+}
+
+/* Print ========================================================================*/
+
+size_t Print::write(const uint8_t *buf, size_t len)
+{
+size_t n;
+
+  for(n=0;n<len;n++)
+    write(buf[n]);
+  return len;
+}
+
+size_t Print::print(const char *s)
+{
+  return write((const uint8_t *)s,strlen(s));
+}
+
+size_t Print::print(char c)
+{
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char n, int base)
+{
+  return printNumber(n,base);
+}
+
+size_t Print::print(int n, int base)
+{
+  return print((long)n,base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+  return printNumber(n,base);
+}
+
+size_t Print::print(long n, int base)
+{
+  if(base==DEC && n<0)
+    return print('-') + printNumber(-(unsigned long)n,base);
+  return printNumber((uint32_t)n,base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  return printNumber(n,base);
+}
+
+size_t Print::print(double n, int digits)
+{
+  return printFloat(n,digits);
+}
+
+size_t Print::println(void)
+{
+  return print("\r\n");
+}
+
+size_t Print::println(const char *s)
+{
+  return print(s) + println();
+}
+
+size_t Print::println(char c)
+{
+  return print(c) + println();
+}
+
+size_t Print::println(unsigned char n, int base)
+{
+  return print(n,base) + println();
+}
+
+size_t Print::println(int n, int base)
+{
+  return print(n,base) + println();
+}
+
+size_t Print::println(unsigned int n, int base)
+{
+  return print(n,base) + println();
+}
+
+size_t Print::println(long n, int base)
+{
+  return print(n,base) + println();
+}
+
+size_t Print::println(unsigned long n, int base)
+{
+  return print(n,base) + println();
+}
+
+size_t Print::println(double n, int digits)
+{
+  return print(n,digits) + println();
+}
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+char buf[8*sizeof(long)+1];
+char *s;
+
+  if(base<2)
+    base=10;
+
+  s=&buf[sizeof(buf)-1];
+  *s=0;
+  do
+  {
+    int d = n % base;
+    n /= base;
+    *--s = d<10 ? '0'+d : 'A'+d-10;
+  } while(n);
+
+  return print(s);
+}
+
+size_t Print::printFloat(double n, int digits)
+{
+char buf[48];
+
+  // same output as the Arduino core for the values we print
+  if(isnan(n))
+    return print("nan");
+  if(isinf(n))
+    return print("inf");
+  if(n>4294967040.0 || n<-4294967040.0)
+    return print("ovf");
+
+  snprintf(buf,sizeof(buf),"%.*f",digits,n);
+  return print(buf);
+}
+
+/* Serial =======================================================================*/
+
+void HostSerial::begin(unsigned long baud)
+{
+  setvbuf(stdout,NULL,_IOLBF,0);
+}
+
+int HostSerial::available(void)
+{
+struct pollfd p;
+uint8_t c;
+
+  if(Peeked>=0)
+    return 1;
+  if(Eof)
+    return 0;
+
+  p.fd=0;
+  p.events=POLLIN;
+  if(poll(&p,1,0)<=0)
+    return 0;
+
+  if(::read(0,&c,1)!=1)
+  {
+    Eof=true;
+    return 0;
+  }
+  Peeked=c;
+  return 1;
+}
+
+int HostSerial::read(void)
+{
+int c;
+
+  if(!available())
+    return -1;
+
+  c=Peeked;
+  Peeked=-1;
+  return c;
+}
+
+int HostSerial::peek(void)
+{
+  return available() ? Peeked : -1;
+}
+
+void HostSerial::flush(void)
+{
+  fflush(stdout);
+}
+
+int HostSerial::availableForWrite(void)
+{
+  return 64;        // a USB packet, as the SAMD21 CDC port takes
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+  putchar(c);
+  return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buf, size_t len)
+{
+  return fwrite(buf,1,len,stdout);
+}
+
+bool HostSerial::eof(void)
+{
+  return Eof && Peeked<0;
+}
+
+/* SPI ==========================================================================*/
+
+static host_spi_t spiDevice;
+
+void HostSPIHook(host_spi_t device)
+{
+  spiDevice=device;
+}
+
+void SPIClass::begin(void)
+{
+  Bytes=0;
+}
+
+void SPIClass::end(void)
+{
+}
+
+void SPIClass::setDataMode(uint8_t mode)
+{
+}
+
+void SPIClass::setBitOrder(uint8_t order)
+{
+}
+
+void SPIClass::setClockDivider(uint8_t div)
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  Bytes++;
+  return spiDevice ? spiDevice(data) : 0;
+}
+
+void SPIClass::transfer(void *buf, size_t count)
+{
+uint8_t *b;
+
+  for(b=(uint8_t *)buf;count;count--,b++)
+    *b=transfer(*b);
+}
@@ -0,0 +1,149 @@
+/*------------------------------------------------------------------------------*\
+Host stand-in for the Arduino core
+(c,2003 luis-es)
+
+  Just the part of the Arduino API the firmware uses, so the sketch and
+  its libraries build unchanged on a Linux workstation:
+
+  - GPIO: pin levels kept in a table. Pins can be hooked to a model
+    (see ADF4351Model.h) to follow writes or to drive reads.
+  - Time: millis()/micros() from the monotonic clock, delay() sleeps.
+  - Interrupts: pin edges are looked for every time the sketch reads the
+    time, and the attached handler runs right there.
+  - Flash: an array, or a file with HostFlashFile().
+  - Serial: stdin/stdout, non blocking.
+\*------------------------------------------------------------------------------*/
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#define ARDUINO_HOST
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define CHANGE        2
+#define FALLING       3
+#define RISING        4
+
+#define DEC   10
+#define HEX   16
+#define OCT   8
+#define BIN   2
+
+#define LED_BUILTIN   13
+#define HOST_PINS     64
+
+#ifndef F_CPU
+#define F_CPU 48000000UL
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// ------------------------------------------------------------------ GPIO
+typedef void (*host_pin_write_t)(uint8_t pin, uint8_t val);
+typedef uint8_t (*host_pin_read_t)(uint8_t pin);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Hook a pin to a model: write is called on every digitalWrite,
+// read answers every digitalRead
+void HostPinHook(uint8_t pin, host_pin_write_t write, host_pin_read_t read);
+
+// ------------------------------------------------------------------ Time
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+// Host only: free running nanosecond counter, for benchmarks
+uint32_t HostNanos(void);
+
+// ------------------------------------------------------------ Interrupts
+void noInterrupts(void);
+void interrupts(void);
+
+#define digitalPinToInterrupt(p)  (p)
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+// Host only: run the handlers of the pins that changed since last time
+void HostInterrupts(void);
+
+// ----------------------------------------------------------------- Flash
+// Host only: NOR flash like the SAMD21 one, erased to 0xFF, and writes
+// only clear bits. Blank on every run, unless kept in a file
+#define HOST_FLASH_SIZE 0x40000
+
+void HostFlashFile(const char *path);
+void HostFlashRead(uint32_t addr, void *data, uint32_t len);
+void HostFlashErase(uint32_t addr, uint32_t len);
+void HostFlashWrite(uint32_t addr, const void *data, uint32_t len);
+
+// ---------------------------------------------------------------- Serial
+class Print
+{
+	public:
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buf, size_t len);
+		virtual ~Print() {}
+
+		size_t print(const char *s);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = DEC);
+		size_t print(int n, int base = DEC);
+		size_t print(unsigned int n, int base = DEC);
+		size_t print(long n, int base = DEC);
+		size_t print(unsigned long n, int base = DEC);
+		size_t print(double n, int digits = 2);
+
+		size_t println(void);
+		size_t println(const char *s);
+		size_t println(char c);
+		size_t println(unsigned char n, int base = DEC);
+		size_t println(int n, int base = DEC);
+		size_t println(unsigned int n, int base = DEC);
+		size_t println(long n, int base = DEC);
+		size_t println(unsigned long n, int base = DEC);
+		size_t println(double n, int digits = 2);
+
+	private:
+		size_t printNumber(unsigned long n, int base);
+		size_t printFloat(double n, int digits);
+};
+
+class HostSerial : public Print
+{
+	public:
+		void begin(unsigned long baud);
+		int available(void);
+		int read(void);
+		int peek(void);
+		void flush(void);
+		int availableForWrite(void);
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *buf, size_t len);
+		operator bool() { return true; }
+
+		// true once stdin is closed and every byte was read
+		bool eof(void);
+
+	private:
+		int Peeked = -1;
+		bool Eof = false;
+};
+
+extern HostSerial Serial;
+
+#endif
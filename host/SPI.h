@@ -0,0 +1,48 @@
+/*------------------------------------------------------------------------------*\
+Host stand-in for the Arduino SPI library
+(c,2003 luis-es)
+
+  Bytes are handed to the device hooked with HostSPIHook() (the ADF4351
+  model), which also answers the MISO byte. Nothing hooked reads as 0.
+\*------------------------------------------------------------------------------*/
+#ifndef _HOST_SPI_H
+#define _HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define SPI_CLOCK_DIV2    2
+#define SPI_CLOCK_DIV4    4
+#define SPI_CLOCK_DIV8    8
+#define SPI_CLOCK_DIV16   16
+
+typedef uint8_t (*host_spi_t)(uint8_t mosi);
+
+class SPIClass
+{
+	public:
+		void begin(void);
+		void end(void);
+		void setDataMode(uint8_t mode);
+		void setBitOrder(uint8_t order);
+		void setClockDivider(uint8_t div);
+
+		uint8_t transfer(uint8_t data);
+		void transfer(void *buf, size_t count);
+
+		uint32_t Bytes;     // bytes moved since begin()
+};
+
+extern SPIClass SPI;
+
+// Route SPI bytes to a device model
+void HostSPIHook(host_spi_t device);
+
+#endif
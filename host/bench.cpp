@@ -0,0 +1,25 @@
+/*------------------------------------------------------------------------------*\
+RFG4000 host benchmark
+(c,2003 luis-es)
+
+  Runs the sBENCH.h suite once on the host build and exits. Same cases
+  and CSV as DIAG:BENC? on the board, in ns:
+
+    rfg4000_bench | grep ^bench
+\*------------------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPI.h"
+#include "ADF4351Model.h"
+
+#include "RFG4000.ino"
+
+int main(int argc, char **argv)
+{
+  adfModel.Attach(LE_PIN, LD_PIN);
+  adfModel2.Attach(LE2_PIN, LD2_PIN);
+
+  setup();
+  sBENCH::Suite(&sigGen,&scpi);
+
+  return 0;
+}
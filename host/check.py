@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+#------------------------------------------------------------------------------
+# RFG4000 host regression checks
+# (c,2003 luis-es)
+#
+#   Each case pipes SCPI into rfg4000_host -t and checks the replies, one
+#   per line, and the register words the models latched last: channel 1,
+#   or channel 2 for a field written "2:NAME".
+#   Fields are looked up by name in ADF4351.h, as host/trace.py does.
+#   ctest runs every case (CMakeLists.txt); by hand:
+#
+#     host/check.py build/rfg4000_host pow_m4
+#     host/check.py build/rfg4000_host          (all of them)
+#
+#   A case is: SCPI lines, host options, expected replies as regular
+#   expressions (whole line), expected fields of the last word of each
+#   register, and optionally the SCPI of a plain run whose final words
+#   must be the same.
+#------------------------------------------------------------------------------
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+TREE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+CASES = {
+    "pow_m4": (["POW 5", "POW -4", "POW?"], [], [r"-4\.00"], {"OUT_PWR": 0}, None),
+    "pow_m1": (["POW -1", "POW?"], [], [r"-1\.00"], {"OUT_PWR": 1}, None),
+    "pow_p5": (["POW 5", "POW?"], [], [r"5\.00"], {"OUT_PWR": 3}, None),
+    "pow_round": (["POW -2.4", "POW 0.4"], [], [], {"OUT_PWR": 1}, None),
+    "freq_1g": (["FREQ 1e9", "FREQ?", "SYST:ERR?"], [],
+                [r"1000000000", r'0,"No error"'],
+                {"INT": 1600, "FRAC": 77, "MOD": 2270, "RF_DIV": 2}, None),
+    "freq_plan": (["FREQ 1e9", "FREQ:PLAN?"], [],
+                  [r"2499947,20,1,0,8,1600,77,2270,4,-9"], {}, None),
+    "plan_intn": (["ROSC:ADJ:VAL 0", "PLL:OPT 1", "FREQ 1003125000", "FREQ:PLAN?"], [],
+                  [r"12500000,2,0,0,8,321,0,2,4,0"], {"INT": 321, "FRAC": 0, "R_COUNTER": 2}, None),
+    "undefined_header": (["FOO", "SOUR:FRQ", "FREQ:BAR 1", "SYST:ERR?", "SYST:ERR?", "SYST:ERR?",
+                          "SYST:ERR?"], [],
+                         [r'-113,"Undefined header;.*"'] * 3 + [r'0,"No error"'], {}, None),
+    "sav_rcl": (["FREQ 1.5e9", "POW 2", "*SAV 1", "FREQ 2e9", "POW -4", "*RCL 1", "FREQ?", "POW?",
+                 "FREQ:PLAN?", "SYST:ERR?"], ["-f", "{flash}"],
+                [r"1500000000", r"2\.00", r"2499947,20,1,0,8,1200,13,511,2,-283", r'0,"No error"'], {},
+                ["FREQ 1.5e9", "POW 2"]),
+    "rcl_rosc": (["ROSC:ADJ:VAL 100", "*SAV 1", "ROSC:ADJ:VAL 0", "*RCL 1", "ROSC:ADJ:VAL?",
+                  "SOUR2:FREQ:PLAN?", "SYST:ERR?"], ["-f", "{flash}"],
+                 [r"100", r"2500010,.*", r'0,"No error"'], {}, None),
+    "rcl_empty": (["*RCL 3", "SYST:ERR?"], ["-f", "{flash}"],
+                  [r'-250,"Mass storage error;\*RCL .*"'], {}, None),
+    "hop_class": (["HOP:CHAN:STAR 1e9", "HOP:CHAN:COUN 8", "HOP:SEQ 0,1,2,3,4,5,6,7", "HOP:STAT ON",
+                   "HOP:CLAS?", "HOP:STAT OFF", "HOP:CHAN 1e9,2.5e9", "HOP:SEQ 0,1,0,1", "HOP:STAT ON",
+                   "HOP:CLAS?", "HOP:STAT OFF", "SYST:ERR?"], [],
+                  [r"8,0", r"0,4", r'0,"No error"'], {}, None),
+    "hop_rand": (["HOP:SEQ:RAND?", "HOP:CHAN:STAR 1e9", "HOP:CHAN:COUN 8", "HOP:SEQ:RAND 1234", "HOP:SEQ:RAND?",
+                  "HOP:SEQ?", "SYST:ERR?"], [],
+                 [r"0", r"1234", r"100", r'0,"No error"'], {}, None),
+    "sour2": (["SOUR2:SWE:POIN 3", "SOUR2:FREQ:STAR 2e9", "SOUR2:HOP:CHAN 1e9,2e9", "SWE:POIN?",
+               "FREQ:STAR?", "SOUR2:FREQ 2e9", "SOUR2:FREQ?", "FREQ?", "SOUR3:FREQ?", "SYST:ERR?",
+               "SYST:ERR?", "SYST:ERR?", "SYST:ERR?", "SYST:ERR?"], [],
+              [r"101", r"1000000000", r"2000000000", r"4300654321"] +
+              [r'-114,"Header suffix out of range;.*"'] * 4 + [r'0,"No error"'],
+              {"2:INT": 1600, "2:RF_DIV": 1}, None),
+    "freq_all": (["FREQ:ALL 1e9,2e9", "FREQ:ALL?", "FREQ?", "SOUR2:FREQ?", "FREQ:ALL 1e9,2e9,3e9",
+                  "FREQ:ALL 1e9,5e9", "FREQ:ALL?", "SYST:ERR?", "SYST:ERR?", "SYST:ERR?"], [],
+                 [r"1000000000,2000000000", r"1000000000", r"2000000000", r"1000000000,2000000000",
+                  r'-108,"Parameter not allowed;.*"', r'101,"Frequency out of range;.*"', r'0,"No error"'],
+                 {"INT": 1600, "RF_DIV": 2, "2:INT": 1600, "2:RF_DIV": 1, "2:FRAC": 77}, None),
+    "opc": (["FREQ 1e9;*OPC?", "*OPC", "*WAI", "*ESR?", "SYST:ERR?"], ["-l", "500"],
+            [r"1", r"129", r'0,"No error"'], {}, None),
+    "opc_timeout": (["FREQ 1e9;*OPC?", "*OPC?", "SYST:ERR?", "SYST:ERR?", "SYST:ERR?", "SYST:ERR?"],
+                    ["-l", "80000"],
+                    [r"1", r"1", r'201,"PLL Unlock;.*"', r'201,"PLL Unlock;.*"',
+                     r'202,"PLL lock timeout;\*OPC .*"', r'0,"No error"'], {}, None),
+}
+
+
+def load_fields():
+    fields = {}
+    text = open(os.path.join(TREE, "ADF4351.h")).read()
+    for m in re.finditer(r'\{(\d+),\s*(\d+),\s*(\d+),\s*\d+,\s*"(\w+)"\}', text):
+        fields[m.group(4)] = tuple(int(g) for g in m.groups()[:3])
+    return fields
+
+
+def run(host, lines, opts):
+    p = subprocess.run([host, "-t"] + opts, input="".join(l + "\n" for l in lines),
+                       capture_output=True, text=True, timeout=20)
+    words = {}
+    for m in re.finditer(r"^\[adf(2?)\] R(\d)=([0-9A-F]{8})", p.stderr, re.M):
+        words[m.group(1) + ":" * bool(m.group(1)) + m.group(2)] = int(m.group(3), 16)
+    return p.stdout.splitlines(), words
+
+
+def check(host, name):
+    lines, opts, replies, expect, same = CASES[name]
+    fails = []
+    with tempfile.TemporaryDirectory() as tmp:
+        opts = [o.replace("{flash}", os.path.join(tmp, "flash")) for o in opts]
+        out, words = run(host, lines, opts)
+
+    if len(out) != len(replies) or not all(re.fullmatch(r, o) for r, o in zip(replies, out)):
+        fails.append("replies %r, expected %r" % (out, replies))
+
+    fields = load_fields()
+    for f, v in expect.items():
+        chip = f[:2] if f.startswith("2:") else ""
+        reg, shift, width = fields[f[len(chip):]]
+        word = words.get(chip + str(reg), 0)
+        got = (word >> shift) & ((1 << width) - 1)
+        if got != v:
+            fails.append("%s=%d, expected %d (%sR%d=%08X)" % (f, got, v, chip, reg, word))
+
+    if same:
+        ref = run(host, same, [])[1]
+        for r in sorted(ref):
+            if words.get(r) != ref[r]:
+                fails.append("R%s=%08X, a plain run has %08X" % (r, words.get(r, 0), ref[r]))
+
+    for f in fails:
+        print("%s: %s" % (name, f))
+    return not fails
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: %s rfg4000_host [case...]" % sys.argv[0])
+        return 2
+    names = sys.argv[2:] or sorted(CASES)
+    bad = [n for n in names if not check(sys.argv[1], n)]
+    print("%d of %d passed" % (len(names) - len(bad), len(names)))
+    return 1 if bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
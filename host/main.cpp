@@ -0,0 +1,68 @@
+/*------------------------------------------------------------------------------*\
+RFG4000 host build
+(c,2003 luis-es)
+
+  Runs the unchanged sketch against the host stand-ins and the ADF4351
+  model. SCPI goes in on stdin and answers come out on stdout, so:
+
+    printf 'SOUR:FREQ 1e9\nSYST:ERR?\n' | rfg4000_host -t
+
+  -t        trace every register word latched by the models (stderr)
+  -l us     model loop settling time, after band select (default 200)
+  -r Hz     model reference frequency (default 25 MHz)
+
+  Channel 2 is a second model on the same bus, LE2_PIN/LD2_PIN.
+  -f file   keep the flash (*SAV slots) in file, blank otherwise
+\*------------------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPI.h"
+#include "ADF4351Model.h"
+
+#include "RFG4000.ino"
+
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+int o;
+
+  while((o=getopt(argc,argv,"tl:r:f:"))!=-1)
+  {
+    switch(o)
+    {
+      case 't':
+        adfModel.Trace = adfModel2.Trace = 1;
+        break;
+      case 'l':
+        adfModel.LockTime_us = adfModel2.LockTime_us = strtoul(optarg,NULL,0);
+        break;
+      case 'r':
+        adfModel.REFin = adfModel2.REFin = strtoul(optarg,NULL,0);
+        break;
+      case 'f':
+        HostFlashFile(optarg);
+        break;
+      default:
+        fprintf(stderr,"usage: %s [-t] [-l lock_us] [-r refin_hz] [-f flash_file]\n",argv[0]);
+        return 1;
+    }
+  }
+
+  adfModel.Attach(LE_PIN, LD_PIN);
+  adfModel2.Attach(LE2_PIN, LD2_PIN);
+
+  setup();
+  while(!Serial.eof())
+    loop();
+  resp.Flush();
+
+  if(adfModel.Trace)
+  {
+    fprintf(stderr,"[adf] fVCO=%.3f Hz fOUT=%.3f Hz %s\n",
+      adfModel.VCO(),adfModel.Output(),adfModel.Locked() ? "locked" : "unlocked");
+    fprintf(stderr,"[adf2] fVCO=%.3f Hz fOUT=%.3f Hz %s\n",
+      adfModel2.VCO(),adfModel2.Output(),adfModel2.Locked() ? "locked" : "unlocked");
+  }
+
+  return 0;
+}
@@ -0,0 +1,271 @@
+/*------------------------------------------------------------------------------*\
+RFG4000 host frequency plan compiler
+(c,2003 luis-es)
+
+  Plans a frequency list or range offline, with the firmware's own
+  ADF4351.h and sPLAN.h, so the words are the ones the board would
+  compute. Points are spread over a pool of threads, each with its own
+  driver object that never touches the chip (Reset() and MakeREGS()).
+
+    rfg4000_plan -r 1e9,2e9,1000001 -o sweep.bin
+    rfg4000_plan -l freqs.txt -j 8 -O -o list.bin
+
+  -r start,stop,points   range, Hz, same points as SOUR:SWE
+  -l file                list, one frequency per line, Hz (- for stdin)
+  -o file                binary table out
+  -j threads             default: one per core
+  -e Hz                  reference error, as SOUR:ROSC:ADJ:VAL (default 0)
+  -p dBm                 output power, as SOUR:POW (default -4)
+  -m MOD                 fixed modulus, as hop channels are planned
+  -O                     plan optimizer on, as SOUR:PLL:OPT ON
+  -F                     fast settle on, as SOUR:PLL:FAST ON
+
+  Points per second go to stderr. A table is sent to the board's list
+  memory, up to SWEEP_MAX points, as SOUR:LIST:REG lines:
+
+    rfg4000_plan -s list.bin > list.scpi
+
+  Table, little endian: a PlanHeader, then Count PlanPoint. A point that
+  can't be synthesized has all its words 0.
+\*------------------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPI.h"
+
+#include "ADF4351.h"
+#include "sSWEEP.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define PLAN_MAGIC    0x50474652    // "RFGP"
+#define PLAN_VERSION  1
+#define PLAN_CHUNK    4096          // points a thread takes at a time
+
+struct PlanHeader
+{
+  uint32_t Magic;
+  uint16_t Version;
+  uint16_t PointLen;      // sizeof(PlanPoint)
+  uint32_t Count;
+  uint32_t Flags;         // bit 0 optimizer, bit 1 fast settle
+};
+
+struct PlanPoint
+{
+  uint64_t Freq;          // requested, Hz
+  uint32_t REG[5];        // R0-R4
+  int32_t  Err_mHz;       // synthesized - requested
+};
+
+static_assert(sizeof(PlanHeader)==16 && sizeof(PlanPoint)==32, "table layout");
+
+ADF4351 master;
+std::vector<uint64_t> freqs;      // list, empty for a range
+uint64_t rangeStart,rangeStop;
+uint32_t count;
+uint16_t modulus;
+std::vector<PlanPoint> table;
+std::atomic<uint32_t> nextPoint;
+std::atomic<uint32_t> badPoints;
+
+// Point i of the range, as RunSweep() steps it
+uint64_t PointFreq(uint32_t i)
+{
+  if(!freqs.empty())
+    return freqs[i];
+  if(count<2)
+    return rangeStart;
+  if(rangeStop>=rangeStart)
+    return rangeStart + (rangeStop-rangeStart)*i/(count-1);
+  return rangeStart - (rangeStart-rangeStop)*i/(count-1);
+}
+
+void Worker(void)
+{
+ADF4351 synth=master;
+PLLPlan plan;
+PlanPoint *p;
+uint32_t i,end,bad;
+
+  bad = 0;
+  for(;;)
+  {
+    i = nextPoint.fetch_add(PLAN_CHUNK);
+    if(i>=count)
+      break;
+    end = i+PLAN_CHUNK < count ? i+PLAN_CHUNK : count;
+    for(;i<end;i++)
+    {
+      p = &table[i];
+      p->Freq = PointFreq(i);
+      if(synth.MakeREGS(p->Freq, p->REG, modulus, &plan))
+      {
+        memset(p->REG,0,sizeof(p->REG));
+        p->Err_mHz = 0;
+        bad++;
+      }
+      else
+        p->Err_mHz = plan.Err_mHz;
+    }
+  }
+  badPoints += bad;
+}
+
+bool ReadList(const char *name)
+{
+FILE *f;
+char line[64];
+
+  f = strcmp(name,"-") ? fopen(name,"r") : stdin;
+  if(!f)
+    return 0;
+  while(fgets(line,sizeof(line),f))
+    if(line[strspn(line," \t")]!='\n' && line[0]!='#')
+      freqs.push_back((uint64_t)(strtod(line,NULL)+0.5));
+  if(f!=stdin)
+    fclose(f);
+  return 1;
+}
+
+// Table to SOUR:LIST:REG lines on stdout
+int ToSCPI(const char *name)
+{
+FILE *f;
+PlanHeader h;
+PlanPoint p;
+uint32_t i;
+
+  f = fopen(name,"rb");
+  if(!f || fread(&h,sizeof(h),1,f)!=1 || h.Magic!=PLAN_MAGIC || h.PointLen!=sizeof(PlanPoint))
+  {
+    fprintf(stderr,"%s: not a plan table\n",name);
+    return 1;
+  }
+  if(h.Count>SWEEP_MAX)
+    fprintf(stderr,"%s: %u points, the list takes the first %u\n",name,h.Count,SWEEP_MAX);
+
+  for(i=0;i<h.Count && i<SWEEP_MAX && fread(&p,sizeof(p),1,f)==1;i++)
+    printf("SOUR:LIST:REG %u,%u,%u,%u,%u,%u\n",i,p.REG[0],p.REG[1],p.REG[2],p.REG[3],p.REG[4]);
+  fclose(f);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+const char *out=NULL;
+std::vector<std::thread> pool;
+PlanHeader h;
+FILE *f;
+double t0,t1,t2,secs;
+unsigned threads;
+int o,c;
+
+  threads = std::thread::hardware_concurrency();
+  count = 0;
+  modulus = 0;
+  master.Reset();
+  traceMask = 0;          // the ring is not for threads
+  h.Flags = 0;
+
+  while((o=getopt(argc,argv,"r:l:o:j:e:p:m:OFs:"))!=-1)
+  {
+    switch(o)
+    {
+      case 'r':
+        if(sscanf(optarg,"%lf,%lf,%lf",&t0,&t1,&t2)!=3 || t2<1 || t2>0xFFFFFFFF)
+        {
+          fprintf(stderr,"bad range: %s\n",optarg);
+          return 1;
+        }
+        rangeStart = (uint64_t)(t0+0.5);
+        rangeStop = (uint64_t)(t1+0.5);
+        count = (uint32_t)t2;
+        break;
+      case 'l':
+        if(!ReadList(optarg))
+        {
+          perror(optarg);
+          return 1;
+        }
+        count = freqs.size();
+        break;
+      case 'o':
+        out = optarg;
+        break;
+      case 'j':
+        threads = strtoul(optarg,NULL,0);
+        break;
+      case 'e':
+        master.REFin_Err = strtol(optarg,NULL,0);
+        break;
+      case 'p':
+        master.SetPower(lround(strtod(optarg,NULL)*100));
+        break;
+      case 'm':
+        modulus = strtoul(optarg,NULL,0);
+        break;
+      case 'O':
+        master.SetOptimize(1);
+        h.Flags |= 1;
+        break;
+      case 'F':
+        master.SetFastSettle(1);
+        h.Flags |= 2;
+        break;
+      case 's':
+        return ToSCPI(optarg);
+      default:
+        count = 0;
+        out = NULL;
+        break;
+    }
+  }
+  if(!out || count==0)
+  {
+    fprintf(stderr,"usage: %s (-r start,stop,points | -l file) -o table [-j threads] [-e ref_err_hz]\n"
+                   "       [-p dbm] [-m mod] [-O] [-F]\n"
+                   "       %s -s table\n",argv[0],argv[0]);
+    return 1;
+  }
+  if(threads<1)
+    threads = 1;
+
+  // R4 as the firmware has it with the output on
+  master.SetOut(1);
+
+  table.resize(count);
+  nextPoint = 0;
+  badPoints = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for(c=0;c<(int)threads;c++)
+    pool.push_back(std::thread(Worker));
+  for(c=0;c<(int)threads;c++)
+    pool[c].join();
+  secs = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+  f = fopen(out,"wb");
+  if(!f)
+  {
+    perror(out);
+    return 1;
+  }
+  h.Magic = PLAN_MAGIC;
+  h.Version = PLAN_VERSION;
+  h.PointLen = sizeof(PlanPoint);
+  h.Count = count;
+  if(fwrite(&h,sizeof(h),1,f)!=1 || fwrite(table.data(),sizeof(PlanPoint),count,f)!=count)
+  {
+    perror(out);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+
+  fprintf(stderr,"%u points, %u threads, %.3f s, %.0f points/s, %u uncomputable\n",
+    count,threads,secs,count/secs,(uint32_t)badPoints);
+  return badPoints ? 2 : 0;
+}
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#------------------------------------------------------------------------------
+# RFG4000 trace decoder
+# (c,2003 luis-es)
+#
+#   Turns the SYST:TRAC:DATA? block back into text. Events and their
+#   formats come from sTRACE.h, register fields from ADF4351.h, so both
+#   are read from the source tree next to this script:
+#
+#     printf 'SOUR:FREQ 1e9\nSYST:TRAC:DATA?\n' | rfg4000_host | host/trace.py
+#     host/trace.py capture.bin
+#
+#   Any text around the block is skipped; several blocks are decoded in
+#   turn. Each record prints as: time (us), sequence number, event.
+#------------------------------------------------------------------------------
+import os
+import re
+import struct
+import sys
+
+TREE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+RECORD = struct.Struct("<IHHII")     # TraceRecord
+
+
+def load_events():
+    events = []
+    text = open(os.path.join(TREE, "sTRACE.h")).read()
+    body = text[text.index("enum TraceEvent"):]
+    body = body[:body.index("};")]
+    for m in re.finditer(r"^[ \t]*(TR_\w+),?[ \t]*(?://[ \t]*\"(.*)\")?", body, re.M):
+        events.append((m.group(1), m.group(2) or m.group(1)))
+    return events
+
+
+def load_fields():
+    fields = []
+    text = open(os.path.join(TREE, "ADF4351.h")).read()
+    for m in re.finditer(r'\{(\d+),\s*(\d+),\s*(\d+),\s*\d+,\s*"(\w+)"\}', text):
+        fields.append(tuple(int(g) for g in m.groups()[:3]) + (m.group(4),))
+    return fields
+
+
+def decode_word(fields, reg, word):
+    return ",".join("%s=%d" % (name, (word >> shift) & ((1 << width) - 1))
+                    for r, shift, width, name in fields if r == reg)
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def render(fmt, a, b, fields):
+    def field(m):
+        name, spec = m.group(1), m.group(2)
+        if name == "ab":
+            return str(a | b << 32)
+        v = a if name == "a" else b
+        if spec is None:
+            return str(v)
+        if spec == "d":
+            return str(signed(v))
+        if spec == "x":
+            return "%08X" % v
+        if spec == "hi":
+            return str(v >> 16)
+        if spec == "lo":
+            return str(v & 0xFFFF)
+        if spec == "r":
+            return str(v & 7)
+        if spec == "w":
+            # a word carries its register; a readback is for register a
+            return decode_word(fields, a if name == "b" else v & 7, v)
+        return m.group(0)
+    return re.sub(r"\{(ab|a|b)(?::(\w+))?\}", field, fmt)
+
+
+def blocks(data):
+    i = 0
+    while True:
+        i = data.find(b"#", i)
+        if i < 0 or i + 2 > len(data):
+            return
+        digits = data[i + 1:i + 2]
+        if not digits.isdigit() or digits == b"0":
+            i += 1
+            continue
+        n = int(digits)
+        size = data[i + 2:i + 2 + n]
+        if len(size) < n or not size.isdigit():
+            i += 1
+            continue
+        start = i + 2 + n
+        yield data[start:start + int(size)]
+        i = start + int(size)
+
+
+def main():
+    data = open(sys.argv[1], "rb").read() if len(sys.argv) > 1 else sys.stdin.buffer.read()
+    events = load_events()
+    fields = load_fields()
+    last = None
+    for block in blocks(data):
+        for off in range(0, len(block) - RECORD.size + 1, RECORD.size):
+            t, ev, seq, a, b = RECORD.unpack_from(block, off)
+            if last is not None and seq != (last + 1) & 0xFFFF:
+                print("%12s %5s ... %d lost" % ("", "", (seq - last - 1) & 0xFFFF))
+            last = seq
+            name, fmt = events[ev] if ev < len(events) else ("TR_%d" % ev, "a={a:x} b={b:x}")
+            print("%12d %5d %s" % (t, seq, render(fmt, a, b, fields)))
+
+
+if __name__ == "__main__":
+    main()
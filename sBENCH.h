@@ -0,0 +1,442 @@
+/*------------------------------------------------------------------------------*\
+Simple Benchmark suite
+(c,2003 luis-es)
+
+  Times the hot paths of a SCPI retune, each case BENCH_SAMPLES times:
+
+    overhead          empty measurement, to subtract from the others
+    plan_float/divN   the old float SetFreq math (reference only)
+    plan_int/divN     integer planner (sPLAN.h), reference path at run time
+    plan_const/divN   same planner, reference path folded in (ADF435x)
+    plan_best/divN    plan optimizer, reference path searched
+    plan_best_worst   same, a few Hz off integer-N at every PFD: no plan
+                      is close enough, all PLAN_SEARCH_MAX are tried
+    encode/RN         every field of a register set in place, from the
+                      register map (ADF4351.h), to its reset value
+    field_set         one field set in place, INT
+    spi_word          one register word over SPI
+    trace             one trace record put (sTRACE.h), level on
+    error_push        one error queued and read back as its SYST:ERR? text
+                      (sSCPI.h), trace level off
+    format_freq       a 10 digit frequency formatted into the reply
+                      ring (sRESP.h), the FREQ? answer
+    setfreq/divN      ADF4351::SetFreq, plan cache missed
+    setfreq_hit/divN  ADF4351::SetFreq, plan cache hit
+    parse/<header>    sSCPI::Parse of a whole line, handler stubbed out
+    number_strtod/<v> strtod, the old argument conversion (reference only)
+    number_fixed/<v>  sSCPI fixed point value reader, same text
+    e2e/<header>      last byte of a line to return from the handler,
+                      that is, to the last SPI word latched
+
+  Output is one CSV line per case, after a header line:
+
+    bench,name,unit,samples,min,median,p99
+
+  Units are CPU cycles on SAMD21 (SysTick), ns on the host build and us
+  anywhere else.
+
+  Define this based on the time you want to spend
+*/
+#define BENCH_SAMPLES 101
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SBENCH_H
+#define _SBENCH_H
+
+#include "sPLAN.h"
+#include "ADF4351.h"
+#include "sSCPI.h"
+#include "sRESP.h"
+
+#if defined(ARDUINO_ARCH_SAMD)
+#define BENCH_UNIT "cyc"
+#elif defined(ARDUINO_HOST)
+#define BENCH_UNIT "ns"
+#else
+#define BENCH_UNIT "us"
+#endif
+
+// one frequency per RF divider band, VCO divided by 2^n
+const uint32_t benchFreqs_kHz[] = {
+  3300007, 1650011, 825013, 412517, 206251, 103127, 51563
+};
+#define BENCH_NFREQ (sizeof(benchFreqs_kHz)/sizeof(benchFreqs_kHz[0]))
+
+// argument text, read as Hz
+const char *benchNumbers[] = {
+  "4300654321", "1.5e9", "433.92MHz", "-2.5"
+};
+#define BENCH_NNUM (sizeof(benchNumbers)/sizeof(benchNumbers[0]))
+const sSCPI::Number benchHz = {sSCPI::UNIT_HZ, 0, 0, 4400000000LL, 0};
+volatile double benchSink;
+
+// Free running counter, in BENCH_UNIT
+uint32_t BenchNow(void)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+uint32_t ms,val;
+
+  // SysTick counts down from LOAD every millisecond; a reload between
+  // both reads of millis() shows up as a change, so read again
+  do
+  {
+    ms = millis();
+    val = SysTick->VAL;
+  } while(ms!=millis());
+
+  return ms*(SysTick->LOAD+1) + (SysTick->LOAD-val);
+#elif defined(ARDUINO_HOST)
+  return HostNanos();
+#else
+  return micros();
+#endif
+}
+
+// The float path formerly in ADF4351::SetFreq, kept only as a reference
+uint8_t LegacyPlanFreq(double freq, float fREF, PLLPlan *plan)
+{
+float fRES,N,fPFD,frac,mod;
+double fVCO;
+int gcd,div;
+
+  fRES=1000;
+  fPFD = fREF / 20.0;
+  fPFD *= 2.0;
+
+  div=0;
+  fVCO=freq;
+  while(div<6 && fVCO<2200e6)
+  {
+    fVCO*=2;
+    div++;
+  }
+
+  N = fVCO / fPFD;
+  plan->Integer = (uint16_t)N;
+  mod  = fPFD / fRES;
+  frac = mod * ( N - (double)plan->Integer);
+  plan->RFDivider = div;
+
+  if(frac==0)
+  {
+    plan->Fractional=0;
+    plan->Modulus=2;
+    return 0;
+  }
+  mod=round(mod);
+  frac=round(frac);
+  gcd=getGCD(frac,mod);
+  if(mod>4095 && gcd==1)
+    return 1;
+  plan->Fractional = frac/gcd;
+  plan->Modulus = mod/gcd;
+  return 0;
+}
+
+uint32_t BenchNop(int64_t v, bool qry)
+{
+  return 0;
+}
+
+class sBENCH
+{
+	public:
+		// Run every case, print the CSV. Leaves synth tuned anywhere
+		static void Suite(ADF4351 *synth, sSCPI *scpi);
+
+	private:
+		static uint32_t Samples[BENCH_SAMPLES];
+
+		// Sort Samples[] and print one line
+		static void Report(const char *name, const char *arg, int arg2);
+		// Feed a line to the parser, timing all of it or just the last byte
+		static uint32_t Feed(sSCPI *scpi, const char *line, bool last);
+};
+
+uint32_t sBENCH::Samples[BENCH_SAMPLES];
+
+/* Public Functions =============================================================*/
+
+void sBENCH::Suite(ADF4351 *synth, sSCPI *scpi)
+{
+PLLRef ref,r;
+PLLPlan plan;
+uint32_t t;
+uint64_t f;
+char line[64];
+const char *c;
+int64_t v;
+uint32_t save[6];
+sSCPI::ErrorRecord errors[ERR_MAX];
+uint8_t head,tail,esr,level;
+int s,b,i,j;
+
+  Serial.println("bench,name,unit,samples,min,median,p99");
+
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    t=BenchNow();
+    Samples[s]=BenchNow()-t;
+  }
+  Report("overhead",NULL,-1);
+
+  // ---------------------------------------------------------- planning
+  synth->GetRef(&ref);
+  for(b=0;b<(int)BENCH_NFREQ;b++)
+  {
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      f=(uint64_t)benchFreqs_kHz[b]*1000 + s*1000;
+      t=BenchNow();
+      LegacyPlanFreq((double)f, ref.fREF, &plan);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("plan_float/div",NULL,b);
+
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      f=(uint64_t)benchFreqs_kHz[b]*1000 + s*1000;
+      t=BenchNow();
+      PLLPlanFreq(f, &ref, &plan);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("plan_int/div",NULL,b);
+
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      f=(uint64_t)benchFreqs_kHz[b]*1000 + s*1000;
+      t=BenchNow();
+      PLLPlanFreqK<ADF4351::RK,ADF4351::DK>(f, ref.fREF, ref.Prescaler, &plan);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("plan_const/div",NULL,b);
+
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      f=(uint64_t)benchFreqs_kHz[b]*1000 + s*1000;
+      r=ref;
+      t=BenchNow();
+      PLLPlanBest(f, &r, &plan);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("plan_best/div",NULL,b);
+  }
+
+  // 88 * fREF is integer-N at every PFD 2*fREF/k
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    f=(uint64_t)ref.fREF*88 + 2 + s;
+    r=ref;
+    t=BenchNow();
+    PLLPlanBest(f, &r, &plan);
+    Samples[s]=BenchNow()-t;
+  }
+  Report("plan_best_worst",NULL,-1);
+
+  // --------------------------------------------------- encode and SPI
+  memcpy(save,synth->REG,sizeof(save));
+  for(i=0;i<6;i++)
+  {
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      t=BenchNow();
+      for(j=0;j<ADF_FIELDS;j++)
+        if(adfFields[j].Reg==i)
+          synth->Set(j,adfFields[j].Reset);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("encode/R",NULL,i);
+  }
+
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    t=BenchNow();
+    synth->Set(ADF_INT,s+100);
+    Samples[s]=BenchNow()-t;
+  }
+  Report("field_set",NULL,-1);
+  memcpy(synth->REG,save,sizeof(save));
+
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    t=BenchNow();
+    synth->ShiftREG(synth->REG[5]);
+    Samples[s]=BenchNow()-t;
+  }
+  Report("spi_word",NULL,-1);
+
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    t=BenchNow();
+    Trace(TRACE_ERR, TR_FREQ, s);
+    Samples[s]=BenchNow()-t;
+  }
+  Report("trace",NULL,-1);
+
+  // queue, trace and *ESR put back as they were
+  memcpy(errors,scpi->Errors,sizeof(errors));
+  head=scpi->errHead;
+  tail=scpi->errTail;
+  esr=status.ESR;
+  level=traceMask;
+  traceMask=0;
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    scpi->errHead=scpi->errTail=0;
+    t=BenchNow();
+    scpi->PushError(ERR_DATA_RANGE);
+    scpi->PullError(line,sizeof(line));
+    Samples[s]=BenchNow()-t;
+  }
+  Report("error_push",NULL,-1);
+  memcpy(scpi->Errors,errors,sizeof(errors));
+  scpi->errHead=head;
+  scpi->errTail=tail;
+  status.ESR=esr;
+  status.Errors(head!=tail);
+  traceMask=level;
+
+  resp.Flush();
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    t=BenchNow();
+    resp.Uint(4300654321ULL+s);
+    Samples[s]=BenchNow()-t;
+    resp.Head=resp.Tail;          // not for the port
+    resp.Units=resp.Values=0;
+  }
+  Report("format_freq",NULL,-1);
+
+  // ------------------------------------------------------------ SetFreq
+  for(b=0;b<(int)BENCH_NFREQ;b++)
+  {
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      f=(uint64_t)benchFreqs_kHz[b]*1000 + s*1000;
+      if(synth->Cache)
+        synth->Cache->Clear();
+      t=BenchNow();
+      synth->SetFreq(f);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("setfreq/div",NULL,b);
+
+    // two frequencies, both cached: every call is a hit
+    f=(uint64_t)benchFreqs_kHz[b]*1000;
+    synth->SetFreq(f);
+    synth->SetFreq(f+1000);
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      t=BenchNow();
+      synth->SetFreq(f + (s&1)*1000);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("setfreq_hit/div",NULL,b);
+  }
+
+  // --------------------------------------------- parser, handler stubbed
+  for(i=1;i<scpi->nodeCount;i++)
+  {
+    sSCPI::NodeType *p=&scpi->Nodes[i];
+    sSCPI::func_t func;
+
+    if(!p->function)
+      continue;
+
+    scpi->HeaderName(i,line,sizeof(line)-4);
+    strcat(line," 1\n");
+
+    func=p->function;
+    p->function=BenchNop;
+    for(s=0;s<BENCH_SAMPLES;s++)
+      Samples[s]=Feed(scpi,line,0);
+    p->function=func;
+
+    line[strlen(line)-3]=0;
+    Report("parse/",line,-1);
+  }
+
+  // ------------------------------------------------ argument conversion
+  for(i=0;i<(int)BENCH_NNUM;i++)
+  {
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      t=BenchNow();
+      benchSink=strtod(benchNumbers[i],NULL);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("number_strtod/",benchNumbers[i],-1);
+
+    for(s=0;s<BENCH_SAMPLES;s++)
+    {
+      t=BenchNow();
+      scpi->ValueStart();
+      for(c=benchNumbers[i];*c;c++)
+        scpi->ValueChar(*c);
+      scpi->ValueEnd(&benchHz,&v);
+      Samples[s]=BenchNow()-t;
+    }
+    Report("number_fixed/",benchNumbers[i],-1);
+  }
+
+  // ------------------------------------------------- whole command path
+  for(s=0;s<BENCH_SAMPLES;s++)
+  {
+    snprintf(line,sizeof(line),"SOUR:FREQ %lu000\n",(unsigned long)(1000000+s));
+    Samples[s]=Feed(scpi,line,1);
+  }
+  Report("e2e/SOUR:FREQ",NULL,-1);
+
+  for(s=0;s<BENCH_SAMPLES;s++)
+    Samples[s]=Feed(scpi,"SOUR:FREQ 1000000000\n",1);
+  Report("e2e/SOUR:FREQ_hit",NULL,-1);
+}
+
+/* Private Functions ============================================================*/
+
+uint32_t sBENCH::Feed(sSCPI *scpi, const char *line, bool last)
+{
+uint32_t t;
+
+  if(last)
+  {
+    while(line[1])
+      scpi->Parse(*line++);
+    t=BenchNow();
+    scpi->Parse(*line);
+    return BenchNow()-t;
+  }
+
+  t=BenchNow();
+  while(*line)
+    scpi->Parse(*line++);
+  return BenchNow()-t;
+}
+
+void sBENCH::Report(const char *name, const char *arg, int arg2)
+{
+uint32_t v;
+int i,j;
+
+  // insertion sort, BENCH_SAMPLES is small
+  for(i=1;i<BENCH_SAMPLES;i++)
+  {
+    v=Samples[i];
+    for(j=i;j>0 && Samples[j-1]>v;j--)
+      Samples[j]=Samples[j-1];
+    Samples[j]=v;
+  }
+
+  Serial.print("bench,");Serial.print(name);
+  if(arg)
+    Serial.print(arg);
+  if(arg2>=0)
+    Serial.print(arg2);
+  Serial.print(",");Serial.print(BENCH_UNIT);
+  Serial.print(",");Serial.print(BENCH_SAMPLES);
+  Serial.print(",");Serial.print(Samples[0]);
+  Serial.print(",");Serial.print(Samples[BENCH_SAMPLES/2]);
+  Serial.print(",");Serial.println(Samples[(BENCH_SAMPLES*99)/100]);
+}
+
+#endif
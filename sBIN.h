@@ -0,0 +1,170 @@
+/*------------------------------------------------------------------------------*\
+Simple Binary frame protocol
+(c,2003 luis-es)
+
+  Fixed size frames for fast retuning, on the same port as SCPI. SCPI text
+  is 7-bit, so the sync byte can't show up in it: it starts a frame, and
+  everything else goes on to the SCPI parser.
+
+    0xA5 | op | payload, 8 bytes, little endian | CRC-8 of op and payload
+
+  CRC-8 is polynomial 0x07, initial value 0 (SMBus). With acks on, every
+  frame is answered with one byte, 0x06 when done and 0x15 when not (bad
+  CRC, unknown op or the function refused it). With acks off nothing is
+  sent back and only Errors counts them.
+
+    op 0x00   acks, payload 1 on (default) or 0 off
+    op 0x01   frequency, payload in Hz
+    op 0x02   register word, payload low 32 bits
+    op 0x03   RF output, payload 1 on or 0 off
+
+  A frame not completed within BIN_TIMEOUT_MS is dropped.
+
+  Define this based on the link
+*/
+#define BIN_TIMEOUT_MS  20
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SBIN_H
+#define _SBIN_H
+
+#include "sRESP.h"
+
+#define BIN_SYNC        0xA5
+#define BIN_ACK         0x06
+#define BIN_NAK         0x15
+#define BIN_FRAME_LEN   10      // after the sync byte: op, payload, CRC
+#define BIN_OPS         8
+
+#define BIN_OP_ACK      0x00
+#define BIN_OP_FREQ     0x01
+#define BIN_OP_REG      0x02
+#define BIN_OP_OUT      0x03
+
+class sBIN
+{
+	public:
+		// Frame callback, 0 when done
+		typedef uint8_t (*func_t)(uint64_t);
+
+		sBIN();
+
+		void Register(uint8_t op, func_t function);
+		// True while a frame is coming in: feed the next byte to Parse too
+		bool Busy(void);
+		void Parse(uint8_t byte);
+
+		bool Ack;             // answer each frame
+		uint32_t Frames;      // frames done
+		uint32_t Errors;      // frames refused or broken
+
+	private:
+		func_t Functions[BIN_OPS];
+		uint8_t frame[BIN_FRAME_LEN];
+		uint8_t frameIdx;     // 0 when idle, else bytes in, sync included
+		uint32_t lastByte_ms;
+
+		void Done(uint8_t ok);
+		static uint8_t CRC8(const uint8_t *data, uint8_t len);
+};
+
+
+sBIN::sBIN()
+{
+int i;
+
+  for(i=0;i<BIN_OPS;i++)
+    Functions[i] = 0;
+  Ack = 1;
+  Frames = Errors = 0;
+  frameIdx = 0;
+}
+
+/* Public Functions =============================================================*/
+
+void sBIN::Register(uint8_t op, func_t function)
+{
+  if(op<BIN_OPS)
+    Functions[op] = function;
+}
+
+bool sBIN::Busy(void)
+{
+  if(frameIdx && millis()-lastByte_ms > BIN_TIMEOUT_MS)
+  {
+    frameIdx = 0;       // sender gave up halfway
+    Errors++;
+  }
+  return frameIdx!=0;
+}
+
+void sBIN::Parse(uint8_t c)
+{
+uint64_t payload;
+uint8_t op;
+int i;
+
+  lastByte_ms = millis();
+  if(!frameIdx)
+  {
+    if(c==BIN_SYNC)
+      frameIdx = 1;
+    return;
+  }
+
+  frame[frameIdx-1] = c;
+  if(++frameIdx <= BIN_FRAME_LEN)
+    return;
+  frameIdx = 0;
+
+  if(CRC8(frame,BIN_FRAME_LEN-1)!=frame[BIN_FRAME_LEN-1])
+  {
+    Done(0);
+    return;
+  }
+
+  payload = 0;
+  for(i=8;i>0;i--)
+    payload = (payload<<8) | frame[i];
+
+  op = frame[0];
+  if(op==BIN_OP_ACK)
+  {
+    Ack = 1;            // answer this one anyway
+    Done(1);
+    Ack = payload!=0;
+  }
+  else if(op<BIN_OPS && Functions[op])
+    Done(Functions[op](payload)==0);
+  else
+    Done(0);
+}
+
+/* Private Functions ============================================================*/
+
+void sBIN::Done(uint8_t ok)
+{
+  if(ok)
+    Frames++;
+  else
+    Errors++;
+
+  if(Ack)
+    resp.write(ok ? BIN_ACK : BIN_NAK);
+}
+
+uint8_t sBIN::CRC8(const uint8_t *data, uint8_t len)
+{
+uint8_t crc,b;
+
+  crc = 0;
+  while(len--)
+  {
+    crc ^= *data++;
+    for(b=0;b<8;b++)
+      crc = crc&0x80 ? (crc<<1)^0x07 : crc<<1;
+  }
+  return crc;
+}
+
+#endif
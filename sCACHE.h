@@ -0,0 +1,171 @@
+/*------------------------------------------------------------------------------*\
+Simple Frequency Plan Cache
+(c,2003 luis-es)
+
+  Maps a requested frequency to the finished R0-R4 words, so a repeated
+  frequency goes straight to SPI without planning again.
+
+  All entries belong to the reference settings they were planned with
+  (REFin + error, R counter, doubler, divider, prescaler). Asking with
+  different settings flushes the whole cache.
+
+  Each frequency may live in one of two buckets of CACHE_WAYS entries
+  (two-choice hashing), and goes to the emptier one. Lookups check at
+  most 2*CACHE_WAYS entries. When both buckets are full, one entry of
+  the first is replaced, round robin.
+
+  Define this based on available memory (32 bytes per entry)
+*/
+#define CACHE_SIZE  256       // entries, power of 2
+#define CACHE_WAYS  8
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SCACHE_H
+#define _SCACHE_H
+
+#include "sPLAN.h"
+
+class sCACHE
+{
+	public:
+		sCACHE();
+
+		void Clear(void);
+
+		// Look freq up. On a hit fills reg[0..4] and err (mHz)
+		bool Find(uint64_t freq, const PLLRef *ref, uint32_t *reg, int32_t *err);
+		// Remember the words planned for freq
+		void Store(uint64_t freq, const uint32_t *reg, int32_t err);
+
+		uint32_t Hits;
+		uint32_t Misses;
+
+	private:
+		struct Entry
+		{
+			uint64_t Freq;      // 0 means empty
+			uint32_t REG[5];
+			int32_t  Err_mHz;
+		};
+
+		Entry Table[CACHE_SIZE/CACHE_WAYS][CACHE_WAYS];
+		uint8_t Victim;
+		PLLRef Ref;
+
+		// Both candidate buckets for freq
+		void Buckets(uint64_t freq, uint8_t *b);
+		// Entries in use in a bucket
+		uint8_t Used(uint8_t b);
+};
+
+
+sCACHE::sCACHE()
+{
+  Ref.fREF = 0;
+  Clear();
+  Hits = 0;
+  Misses = 0;
+}
+
+/* Public Functions =============================================================*/
+
+void sCACHE::Clear(void)
+{
+int b,w;
+
+  for(b=0;b<CACHE_SIZE/CACHE_WAYS;b++)
+    for(w=0;w<CACHE_WAYS;w++)
+      Table[b][w].Freq = 0;
+  Victim = 0;
+}
+
+bool sCACHE::Find(uint64_t freq, const PLLRef *ref, uint32_t *reg, int32_t *err)
+{
+Entry *e;
+uint8_t b[2];
+int i,w,c;
+
+  if(ref->fREF!=Ref.fREF || ref->RCounter!=Ref.RCounter || ref->Doubler!=Ref.Doubler ||
+     ref->Divider!=Ref.Divider || ref->Prescaler!=Ref.Prescaler)
+  {
+    // reference path changed: every plan is stale
+    Clear();
+    Ref = *ref;
+  }
+
+  Buckets(freq,b);
+  for(i=0;i<2;i++)
+  {
+    e = Table[b[i]];
+    for(w=0;w<CACHE_WAYS;w++,e++)
+    {
+      if(e->Freq==freq)
+      {
+        for(c=0;c<5;c++)
+          reg[c] = e->REG[c];
+        *err = e->Err_mHz;
+        Hits++;
+        return 1;
+      }
+    }
+  }
+
+  Misses++;
+  return 0;
+}
+
+void sCACHE::Store(uint64_t freq, const uint32_t *reg, int32_t err)
+{
+Entry *e;
+uint8_t b[2],u0,u1;
+int c;
+
+  Buckets(freq,b);
+  u0 = Used(b[0]);
+  u1 = Used(b[1]);
+
+  if(u0<CACHE_WAYS || u1<CACHE_WAYS)
+  {
+    e = u1<u0 ? &Table[b[1]][u1] : &Table[b[0]][u0];
+  }
+  else
+  {
+    e = &Table[b[0]][Victim];
+    Victim = (Victim+1) % CACHE_WAYS;
+  }
+
+  e->Freq = freq;
+  for(c=0;c<5;c++)
+    e->REG[c] = reg[c];
+  e->Err_mHz = err;
+}
+
+/* Private Functions ============================================================*/
+
+void sCACHE::Buckets(uint64_t freq, uint8_t *b)
+{
+uint32_t h;
+
+  h = (uint32_t)freq ^ (uint32_t)(freq>>32);
+  h = (h ^ (h>>16)) * 0x45D9F3B;
+  h = (h ^ (h>>16)) * 0x45D9F3B;
+  h = h ^ (h>>16);
+
+  b[0] = h % (CACHE_SIZE/CACHE_WAYS);
+  b[1] = (h>>16) % (CACHE_SIZE/CACHE_WAYS);
+  if(b[1]==b[0])
+    b[1] = (b[0]+1) % (CACHE_SIZE/CACHE_WAYS);
+}
+
+uint8_t sCACHE::Used(uint8_t b)
+{
+uint8_t w;
+
+  // entries are filled in order and only flushed all at once
+  for(w=0;w<CACHE_WAYS;w++)
+    if(Table[b][w].Freq==0)
+      break;
+  return w;
+}
+
+#endif
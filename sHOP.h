@@ -0,0 +1,344 @@
+/*------------------------------------------------------------------------------*\
+Simple Frequency Hopping engine for ADF4351
+(c,2003 luis-es)
+
+  Channels are planned ahead into ready-to-send words. R1-R4 repeat a lot
+  within a band, so each distinct set is kept once, and a channel is its
+  R0 word plus the number of its set. For that, channels are all planned
+  on the same MOD (Modulus, see PLLPlanFreqMod() in sPLAN.h): GridModulus()
+  gives the one that makes a channel spacing exact, or the finest, 4095,
+  when there is none. The hop sequence is a list of
+  channels, given one by one or drawn pseudo-randomly from a seed.
+
+  At Start() every hop is classed against the one before it:
+  - R0 only: same R1-R4 (divider, MOD, band select...), only INT/FRAC
+    change. One SPI word.
+  - full: R1-R4 differ, the changed words and then R0.
+  Hops are then sent from the timer interrupt (sTIMER.h, shared with
+  sSWEEP: only one of both runs at a time), with an optional pulse on
+  HOP_SYNC_PIN right after each R0.
+
+  A hop sent one dwell or more after it was due is a missed deadline.
+
+  Define this based on available memory and wiring
+*/
+#define HOP_MAX         1024      // hops in the sequence, 1 byte each
+#define HOP_CHANNELS    256       // channels, 5 bytes each
+#define HOP_SETS        16        // distinct R1-R4, 16 bytes each
+#define HOP_DWELL_MIN   20        // us, room for 5 SPI words in the ISR
+#define HOP_SYNC_PIN    5
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SHOP_H
+#define _SHOP_H
+
+#include "ADF4351.h"
+#include "sTIMER.h"
+
+class sHOP
+{
+	public:
+		sHOP();
+
+		// Forget channels and hops
+		void Clear(void);
+		// Forget the hops only
+		void ClearHops(void);
+		// Plan a channel at freq (Hz). Returns its number, -1 if there is
+		// no room or it can't be synthesized
+		int AddChannel(ADF4351 *synth, uint64_t freq);
+		uint16_t Modulus;     // MOD for the channels to come
+		// MOD that puts channels spacing Hz apart exactly on the grid
+		static uint16_t GridModulus(uint32_t fPFD, uint64_t spacing);
+		uint16_t Channels(void);
+		// Append a hop to channel. 0 if there is no such channel or no room
+		bool AddHop(uint8_t channel);
+		// Replace the sequence with count hops over all channels, drawn
+		// from seed, never the same channel twice in a row
+		bool Random(uint32_t seed, uint16_t count);
+		uint16_t Hops(void);
+
+		// Hop through the sequence every dwell_us, over and over
+		bool Start(ADF4351 *synth, uint32_t dwell_us, bool sync);
+		void Stop(void);
+		bool Running(void);
+
+		// Measured hops per second since Start()
+		uint32_t Rate(void);
+		uint32_t Missed;      // deadlines missed since Start()
+		uint16_t R0Only;      // hop classes in the sequence, as started
+		uint16_t Full;
+
+		// Timer callback: send the next hop
+		void Tick(void);
+
+	private:
+		uint32_t ChanR0[HOP_CHANNELS];
+		uint8_t ChanSet[HOP_CHANNELS];
+		uint16_t ChanCount;
+		uint32_t Sets[HOP_SETS][4];   // R1-R4
+		uint8_t SetCount;
+		uint8_t Seq[HOP_MAX];
+		uint8_t SeqFull[HOP_MAX/8];   // bit set: full reprogram
+		uint16_t SeqCount;
+
+		ADF4351 *Synth;
+		bool Sync;
+		uint32_t Period;
+		volatile uint16_t Index;
+		volatile uint32_t Steps;
+		uint32_t StartTime;
+		uint32_t Due;
+		volatile bool Active;
+
+		void Send(uint16_t idx);
+};
+
+sHOP *hopInstance;
+
+void HopTimerISR(void)
+{
+  hopInstance->Tick();
+}
+
+
+sHOP::sHOP()
+{
+  Active = 0;
+  Clear();
+  Modulus = PLAN_MOD_MAX;
+  Missed = 0;
+  R0Only = Full = 0;
+}
+
+/* Public Functions =============================================================*/
+
+void sHOP::Clear(void)
+{
+  if(Active)
+    return;
+
+  ChanCount = 0;
+  SetCount = 0;
+  SeqCount = 0;
+}
+
+int sHOP::AddChannel(ADF4351 *synth, uint64_t freq)
+{
+uint32_t words[5];
+uint8_t s;
+
+  if(Active || ChanCount>=HOP_CHANNELS || synth->MakeREGS(freq, words, Modulus))
+    return -1;
+
+  for(s=0;s<SetCount;s++)
+    if(!memcmp(Sets[s],&words[1],sizeof(Sets[s])))
+      break;
+  if(s==SetCount)
+  {
+    if(SetCount>=HOP_SETS)
+      return -1;
+    memcpy(Sets[s],&words[1],sizeof(Sets[s]));
+    SetCount++;
+  }
+
+  ChanR0[ChanCount] = words[0];
+  ChanSet[ChanCount] = s;
+  return ChanCount++;
+}
+
+uint16_t sHOP::GridModulus(uint32_t fPFD, uint64_t spacing)
+{
+uint64_t a,b,t;
+
+  // fPFD/MOD has to divide spacing: MOD = fPFD / gcd(fPFD,spacing)
+  a = fPFD;
+  b = spacing;
+  while(b)
+  {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  if(a==0 || fPFD/a > PLAN_MOD_MAX)
+    return PLAN_MOD_MAX;
+  if(fPFD/a < 2)
+    return 2;
+  return fPFD/a;
+}
+
+void sHOP::ClearHops(void)
+{
+  if(!Active)
+    SeqCount = 0;
+}
+
+uint16_t sHOP::Channels(void)
+{
+  return ChanCount;
+}
+
+bool sHOP::AddHop(uint8_t channel)
+{
+  if(Active || channel>=ChanCount || SeqCount>=HOP_MAX)
+    return 0;
+
+  Seq[SeqCount++] = channel;
+  return 1;
+}
+
+bool sHOP::Random(uint32_t seed, uint16_t count)
+{
+uint32_t x;
+uint16_t c;
+uint8_t ch;
+
+  if(Active || ChanCount==0 || count>HOP_MAX)
+    return 0;
+
+  // xorshift32, never seeded with 0
+  x = seed ? seed : 0x9E3779B9;
+  for(c=0;c<count;c++)
+  {
+    do
+    {
+      x ^= x<<13;
+      x ^= x>>17;
+      x ^= x<<5;
+      ch = x % ChanCount;
+    } while(ChanCount>1 && c && ch==Seq[c-1]);
+    Seq[c] = ch;
+  }
+  SeqCount = count;
+  return 1;
+}
+
+uint16_t sHOP::Hops(void)
+{
+  return SeqCount;
+}
+
+bool sHOP::Start(ADF4351 *synth, uint32_t dwell_us, bool sync)
+{
+uint16_t i,prev;
+
+  if(SeqCount==0)
+    return 0;
+  if(dwell_us<HOP_DWELL_MIN)
+    dwell_us=HOP_DWELL_MIN;
+
+  Stop();
+
+  // class every hop against the one before, the last one before the first
+  R0Only = Full = 0;
+  memset(SeqFull,0,sizeof(SeqFull));
+  for(i=0;i<SeqCount;i++)
+  {
+    prev = i ? i-1 : SeqCount-1;
+    if(ChanSet[Seq[i]]!=ChanSet[Seq[prev]])
+    {
+      SeqFull[i>>3] |= 1<<(i&7);
+      Full++;
+    }
+    else
+      R0Only++;
+  }
+
+  Synth = synth;
+  Sync = sync;
+  Period = dwell_us;
+  Index = 0;
+  Steps = 0;
+  Missed = 0;
+  hopInstance = this;
+  if(Sync)
+  {
+    pinMode(HOP_SYNC_PIN, OUTPUT);
+    digitalWrite(HOP_SYNC_PIN, LOW);
+  }
+
+  // the first one goes out in full, whatever the chip had
+  SeqFull[0] |= 1;
+  Send(0);
+  if(ChanSet[Seq[0]]==ChanSet[Seq[SeqCount-1]])
+    SeqFull[0] &= ~1;
+
+  StartTime = Due = micros();
+  Active = 1;
+  TimerStart(dwell_us, HopTimerISR);
+  return 1;
+}
+
+void sHOP::Stop(void)
+{
+  if(!Active)
+    return;
+
+  TimerStop();
+  Active = 0;
+}
+
+bool sHOP::Running(void)
+{
+  return Active;
+}
+
+uint32_t sHOP::Rate(void)
+{
+uint32_t t;
+
+  t = micros() - StartTime;
+  if(!Active || t==0)
+    return 0;
+
+  return (uint64_t)Steps * 1000000 / t;
+}
+
+void sHOP::Tick(void)
+{
+uint16_t i;
+
+  if(!Active)
+    return;
+
+  i = Index + 1;
+  if(i>=SeqCount)
+    i=0;
+  Index = i;
+
+  Send(i);
+  Steps++;
+
+  Due += Period;
+  if((int32_t)(micros() - Due) >= (int32_t)Period)
+  {
+    Missed++;
+    Due = micros();       // late: take it from here
+  }
+}
+
+/* Private Functions ============================================================*/
+
+void sHOP::Send(uint16_t idx)
+{
+uint32_t words[5];
+uint8_t ch;
+
+  ch = Seq[idx];
+  if(SeqFull[idx>>3] & (1<<(idx&7)))
+  {
+    words[0] = ChanR0[ch];
+    memcpy(&words[1],Sets[ChanSet[ch]],sizeof(Sets[0]));
+    Synth->LoadREGS(words);
+  }
+  else
+    Synth->LoadR0(ChanR0[ch]);
+
+  if(Sync)
+  {
+    digitalWrite(HOP_SYNC_PIN, HIGH);
+    digitalWrite(HOP_SYNC_PIN, LOW);
+  }
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*------------------------------------------------------------------------------*\
+Simple PLL Frequency Planner for ADF4351
+(c,2003 luis-es)
+
+  All-integer INT/FRAC/MOD computation. No float math: frequencies are
+  integer Hz and every ratio is kept as an exact 64-bit fraction, so this
+  runs the same on a FPU-less M0+ and on the host.
+
+  fPFD = fREF * (1 + D) / (R * (1 + T))
+  fOUT = fPFD * (INT + FRAC/MOD) / 2^RFDivider
+
+  When FRAC/MOD can't be exact with MOD <= 4095, the best rational
+  approximation (continued fractions) is taken, and the resulting
+  frequency error is returned along with the plan.
+
+  PLLPlanFreqK<>() is the same planner with the reference divisions
+  (R counter, doubler, divider) given at compile time: they fold into
+  constants, and the PFD frequency takes a multiply instead of a 64-bit
+  division.
+
+  PLLPlanFreqMod() plans on a given MOD instead, FRAC rounded to it, and
+  stays fractional-N even when FRAC is 0: frequencies on a common MOD and
+  RF divider differ in R0 only.
+
+  PLLPlanWords() goes the other way: the frequency and error of a plan
+  read back from register words, as *RCL puts them on the chip.
+
+  PLLPlanBest() also picks the reference path. It walks the PFD
+  frequencies 2*fREF/k, highest first, within the chip limits: 45 MHz in
+  integer-N, 32 MHz in fractional-N. Doubler off is tried before doubler
+  on for the same PFD. The prescaler is 8/9 when INT allows it, else
+  4/5. It keeps the plan with
+    - the smallest error, in steps of PLAN_ERR_RES_MHZ: closer than that
+      is no better, and isn't worth a lower PFD
+    - then integer-N, at any PFD: no fractional spurs
+    - then the highest PFD, for lower in-band noise.
+  It stops at an integer-N plan with the error under PLAN_ERR_RES_MHZ,
+  or after PLAN_SEARCH_MAX PFDs, so a call costs at most that many plans.
+
+  Define this based on the time a retune can take, and the accuracy needed
+*/
+#define PLAN_SEARCH_MAX   16            // PFD frequencies tried
+#define PLAN_ERR_RES_MHZ  1000          // mHz
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SPLAN_H
+#define _SPLAN_H
+
+#include <stdint.h>
+
+#define PLAN_FREQ_MIN   35000000ULL     // Hz
+#define PLAN_FREQ_MAX   4400000000ULL   // Hz
+#define PLAN_VCO_MIN    2200000000ULL   // Hz
+#define PLAN_MOD_MAX    4095
+#define PLAN_DIV_MAX    6               // RF divider is 2^0 .. 2^6
+#define PLAN_PFD_MAX_INT  45000000UL    // Hz
+#define PLAN_PFD_MAX_FRAC 32000000UL    // Hz
+#define PLAN_DBL_REF_MAX  30000000UL    // Hz, highest REFin with the doubler
+#define PLAN_VCO_PS45_MAX 3600000000ULL // Hz, highest VCO with the 4/5 prescaler
+
+// Reference path settings, as programmed in R1/R2
+struct PLLRef
+{
+  uint32_t fREF;          // Reference frequency (REFin + error) in Hz
+  uint16_t RCounter;      // 1..1023
+  bool     Doubler;       // D
+  bool     Divider;       // T
+  bool     Prescaler;     // 0 - 4/5    1 - 8/9
+};
+
+// Result of planning one frequency
+struct PLLPlan
+{
+  uint16_t Integer;
+  uint16_t Fractional;    // 0 means integer-N mode
+  uint16_t Modulus;
+  uint8_t  RFDivider;     // R4 encoding: output = VCO / 2^RFDivider
+  uint32_t fPFD;          // Hz, truncated (for band select clock only)
+  uint64_t fOut_mHz;      // actually synthesized frequency, in mHz
+  int64_t  Err_mHz;       // fOut - requested, in mHz
+};
+
+// Returns 0 on success, 1 if freq (Hz) can't be synthesized
+uint8_t PLLPlanFreq(uint64_t freq, const PLLRef *ref, PLLPlan *plan);
+// Same, on a fixed MOD (2..4095)
+uint8_t PLLPlanFreqMod(uint64_t freq, const PLLRef *ref, uint16_t mod, PLLPlan *plan);
+// Same as PLLPlanFreq, RK = R * (1 + T) and DK = 1 + D fixed
+template<uint32_t RK, uint32_t DK>
+uint8_t PLLPlanFreqK(uint64_t freq, uint32_t fREF, bool prescaler, PLLPlan *plan);
+// Best reference path and plan for freq, from fREF (Hz) and the
+// reference divider ref->Divider: fills in the rest of ref
+uint8_t PLLPlanBest(uint64_t freq, PLLRef *ref, PLLPlan *plan);
+// Phase detector frequency, Hz truncated
+uint32_t PLLRefPFD(const PLLRef *ref);
+// A plan already in the registers, INT/FRAC/MOD/RF divider set: fills in
+// fPFD, the synthesized frequency and its error against freq
+uint8_t PLLPlanWords(uint64_t freq, const PLLRef *ref, PLLPlan *plan);
+
+static inline uint8_t PLLPlanCore(uint64_t freq, uint32_t fREF, uint32_t rk, uint32_t dk,
+  bool prescaler, uint32_t fPFD, PLLPlan *plan) __attribute__((always_inline));
+static uint8_t PLLPlanOut(uint64_t freq, uint32_t fREF, uint32_t rk, uint32_t dk,
+  bool prescaler, PLLPlan *plan);
+
+
+/* Public Functions =============================================================*/
+
+uint8_t PLLPlanFreq(uint64_t freq, const PLLRef *ref, PLLPlan *plan)
+{
+  if(ref->RCounter==0)
+    return 1;
+
+  return PLLPlanCore(freq, ref->fREF, ref->RCounter * (ref->Divider ? 2 : 1),
+    ref->Doubler ? 2 : 1, ref->Prescaler, PLLRefPFD(ref), plan);
+}
+
+template<uint32_t RK, uint32_t DK>
+uint8_t PLLPlanFreqK(uint64_t freq, uint32_t fREF, bool prescaler, PLLPlan *plan)
+{
+  // fREF * DK fits in 32 bits, see ADF435x
+  return PLLPlanCore(freq, fREF, RK, DK, prescaler, fREF * DK / RK, plan);
+}
+
+uint8_t PLLPlanFreqMod(uint64_t freq, const PLLRef *ref, uint16_t mod, PLLPlan *plan)
+{
+uint64_t num,den,rem;
+uint8_t div;
+
+  if(freq<PLAN_FREQ_MIN || freq>PLAN_FREQ_MAX || ref->RCounter==0 || mod<2 || mod>PLAN_MOD_MAX)
+    return 1;
+
+  div=0;
+  while(div<PLAN_DIV_MAX && (freq<<div) < PLAN_VCO_MIN)
+    div++;
+
+  num = (freq<<div) * ref->RCounter * (ref->Divider ? 2 : 1);
+  den = (uint64_t)ref->fREF * (ref->Doubler ? 2 : 1);
+
+  plan->RFDivider = div;
+  plan->fPFD = PLLRefPFD(ref);
+  plan->Integer = num / den;
+  rem = num % den;
+
+  // nearest FRAC on this MOD, carried into INT when it rounds up to MOD
+  plan->Fractional = (rem*mod + den/2) / den;
+  plan->Modulus = mod;
+  if(plan->Fractional==mod)
+  {
+    plan->Integer++;
+    plan->Fractional = 0;
+  }
+
+  return PLLPlanOut(freq, ref->fREF, ref->RCounter * (ref->Divider ? 2 : 1),
+    ref->Doubler ? 2 : 1, ref->Prescaler, plan);
+}
+
+uint8_t PLLPlanBest(uint64_t freq, PLLRef *ref, PLLPlan *plan)
+{
+PLLRef r;
+PLLPlan p;
+uint64_t fVCO,e,best;
+uint32_t k,kmin,t,dk,pfd;
+uint8_t div,n;
+bool found;
+
+  if(freq<PLAN_FREQ_MIN || freq>PLAN_FREQ_MAX || ref->fREF==0)
+    return 1;
+
+  div=0;
+  while(div<PLAN_DIV_MAX && (freq<<div) < PLAN_VCO_MIN)
+    div++;
+  fVCO = freq<<div;
+
+  // PFD = 2*fREF/k, k = 2*R*(1+T)/(1+D). First k under the integer-N limit
+  t = ref->Divider ? 2 : 1;
+  kmin = ((uint64_t)ref->fREF*2 + PLAN_PFD_MAX_INT-1) / PLAN_PFD_MAX_INT;
+  if(kmin<1)
+    kmin = 1;
+
+  found = 0;
+  best = 0;
+  r = *ref;
+  for(k=kmin,n=0;n<PLAN_SEARCH_MAX && k<=2*1023*t;k++)
+  {
+    // doubler off if this k has an R that way, else on
+    for(dk=1;dk<=2;dk++)
+      if((k*dk)%(2*t)==0 && (dk==1 || ref->fREF<=PLAN_DBL_REF_MAX) && k*dk/(2*t)<=1023)
+        break;
+    if(dk>2)
+      continue;
+    n++;
+
+    r.RCounter = k*dk/(2*t);
+    r.Doubler = dk==2;
+    pfd = PLLRefPFD(&r);
+
+    // 8/9 if INT allows, 4/5 otherwise, and up to 3.6 GHz only
+    r.Prescaler = fVCO/pfd >= 75 || fVCO > PLAN_VCO_PS45_MAX;
+    if(PLLPlanFreq(freq, &r, &p))
+      continue;
+    if(p.Fractional && pfd > PLAN_PFD_MAX_FRAC)
+      continue;
+
+    // k only grows, so the PFD only falls: an equal error loses, unless
+    // it is integer-N against fractional-N
+    e = (p.Err_mHz<0 ? -p.Err_mHz : p.Err_mHz) / PLAN_ERR_RES_MHZ;
+    if(!found || e<best || (e==best && !p.Fractional && plan->Fractional))
+    {
+      *plan = p;
+      *ref = r;
+      best = e;
+      found = 1;
+      if(e==0 && !p.Fractional)
+        break;
+    }
+  }
+
+  return !found;
+}
+
+uint32_t PLLRefPFD(const PLLRef *ref)
+{
+  return (uint64_t)ref->fREF * (ref->Doubler ? 2 : 1) / (ref->RCounter * (ref->Divider ? 2 : 1));
+}
+
+uint8_t PLLPlanWords(uint64_t freq, const PLLRef *ref, PLLPlan *plan)
+{
+  plan->fPFD = 0;
+  plan->fOut_mHz = 0;
+  plan->Err_mHz = 0;
+  if(ref->RCounter==0 || plan->Modulus==0)
+    return 1;
+
+  plan->fPFD = PLLRefPFD(ref);
+  return PLLPlanOut(freq, ref->fREF, ref->RCounter * (ref->Divider ? 2 : 1),
+    ref->Doubler ? 2 : 1, ref->Prescaler, plan);
+}
+
+/* Private Functions ============================================================*/
+
+// The planner, reference divisions as factors: constants when inlined
+// from PLLPlanFreqK<>
+static inline uint8_t PLLPlanCore(uint64_t freq, uint32_t fREF, uint32_t rk, uint32_t dk,
+  bool prescaler, uint32_t fPFD, PLLPlan *plan)
+{
+uint64_t fVCO,num,den,rem;
+uint64_t p0,q0,p1,q1,n,d,a,t;
+uint64_t pa,qa,ea,eb;
+uint8_t div;
+
+  if(freq<PLAN_FREQ_MIN || freq>PLAN_FREQ_MAX)
+    return 1;
+
+  // Select the RF divider that keeps the VCO over 2.2 GHz
+  div=0;
+  while(div<PLAN_DIV_MAX && (freq<<div) < PLAN_VCO_MIN)
+    div++;
+  fVCO = freq<<div;
+
+  // N = fVCO / fPFD, as the exact fraction num/den
+  num = fVCO * rk;
+  den = (uint64_t)fREF * dk;
+
+  plan->RFDivider = div;
+  plan->fPFD = fPFD;
+  plan->Integer = num / den;
+  rem = num % den;
+
+  if(rem==0)
+  {
+    // ---------------------------------- exact integer-N
+    plan->Fractional = 0;
+    plan->Modulus = 2;
+  }
+  else
+  {
+    // -------------------------------- best FRAC/MOD for rem/den
+    // walk the convergents while the denominator fits in MOD
+    p0=0;q0=1;p1=1;q1=0;
+    n=rem;d=den;
+    for(;;)
+    {
+      a = n/d;
+      if(q0 + a*q1 > PLAN_MOD_MAX)
+        break;
+      t=p0+a*p1; p0=p1; p1=t;
+      t=q0+a*q1; q0=q1; q1=t;
+      t=n-a*d; n=d; d=t;
+      if(d==0)
+        break;
+    }
+
+    if(d!=0)
+    {
+      // last semiconvergent that fits vs. last convergent: keep the closer
+      a  = (PLAN_MOD_MAX - q0) / q1;
+      pa = p0 + a*p1;
+      qa = q0 + a*q1;
+      ea = (pa*den > rem*qa) ? pa*den - rem*qa : rem*qa - pa*den;
+      eb = (p1*den > rem*q1) ? p1*den - rem*q1 : rem*q1 - p1*den;
+      if(ea*q1 < eb*qa)
+      {
+        p1=pa;
+        q1=qa;
+      }
+    }
+
+    if(p1==0)
+    {
+      plan->Fractional = 0;           // rounded down to integer-N
+      plan->Modulus = 2;
+    }
+    else if(p1==q1)
+    {
+      plan->Integer++;                // rounded up to integer-N
+      plan->Fractional = 0;
+      plan->Modulus = 2;
+    }
+    else
+    {
+      plan->Fractional = p1;
+      plan->Modulus = q1;
+    }
+  }
+
+  return PLLPlanOut(freq, fREF, rk, dk, prescaler, plan);
+}
+
+// Check INT and fill in the synthesized frequency and error
+static uint8_t PLLPlanOut(uint64_t freq, uint32_t fREF, uint32_t rk, uint32_t dk,
+  bool prescaler, PLLPlan *plan)
+{
+uint64_t num,den;
+uint8_t div;
+
+  // INT limits depend on the prescaler
+  if(plan->Integer < (prescaler ? 75 : 23))
+    return 1;
+
+  div = plan->RFDivider;
+
+  // fOUT = fREF*(1+D)*(INT*MOD+FRAC) / (R*(1+T)*MOD*2^div), in mHz
+  num = (uint64_t)fREF * dk *
+        ((uint64_t)plan->Integer * plan->Modulus + plan->Fractional);
+  den = (uint64_t)rk * plan->Modulus << div;
+
+  plan->fOut_mHz = (num / den) * 1000 + ((num % den) * 1000 + den/2) / den;
+  plan->Err_mHz = (int64_t)(plan->fOut_mHz - freq*1000);
+
+  return 0;
+}
+
+#endif
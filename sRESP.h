@@ -0,0 +1,248 @@
+/*------------------------------------------------------------------------------*\
+Simple Response writer
+(c,2003 luis-es)
+
+  Query handlers write their values here, not to Serial. The writer does
+  two jobs.
+
+  It formats the values. Integers and fixed point numbers are converted
+  exactly, with no float and no allocation: a uint64_t in Hz prints all
+  of its digits. SCPI separators go in by themselves:
+  - a ',' between the values of one response;
+  - a ';' between the responses to the queries of one message;
+  - "\r\n" once the message ends (sSCPI calls Begin() and End()).
+  So "FREQ?;POW?" is answered "4300654321;-4.00".
+
+  It also queues the text in a TX ring of RESP_TX_SIZE bytes. Drain(),
+  called on every loop() pass, hands the port only what it can take
+  without waiting, so handlers never stall on output. Replies to
+  back-to-back queries go out together. If a reply outgrows the ring,
+  it is written straight through and that write waits on the port.
+
+  Define this based on available memory and longest usual reply
+*/
+#define RESP_TX_SIZE    256       // bytes, power of 2
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SRESP_H
+#define _SRESP_H
+
+class sRESP : public Print
+{
+	friend class sBENCH;
+
+	public:
+		sRESP();
+
+		// One value of the current response
+		void Uint(uint64_t v);
+		void Int(int64_t v);
+		// v/10^digits, -250,2 is -2.50
+		void Fixed(int64_t v, uint8_t digits);
+		void Str(const char *s);
+		// Separator only, for a value written with print() or write()
+		void Next(void);
+
+		// Query response start and message end, from the parser
+		void Begin(void);
+		void End(void);
+
+		// Send what the port takes now, no waiting
+		void Drain(void);
+		// Send it all, waiting for the port
+		void Flush(void);
+		// Reply text not yet sent, MAV
+		bool Pending(void);
+
+		// Raw bytes into the ring, no separator (Print)
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *buf, size_t len);
+		using Print::write;
+
+		uint32_t Stalls;      // writes that found the ring full
+
+	private:
+		uint8_t Ring[RESP_TX_SIZE];
+		uint16_t Head;        // next byte in, wraps
+		uint16_t Tail;        // next byte out, wraps
+		uint8_t Units;        // responses in this message
+		uint8_t Values;       // values in this response
+
+		void Digits(uint64_t v);
+};
+
+sRESP resp;
+
+
+sRESP::sRESP()
+{
+  Head = Tail = 0;
+  Units = Values = 0;
+  Stalls = 0;
+}
+
+/* Public Functions =============================================================*/
+
+void sRESP::Uint(uint64_t v)
+{
+  Next();
+  Digits(v);
+}
+
+void sRESP::Int(int64_t v)
+{
+  Next();
+  if(v<0)
+  {
+    write('-');
+    Digits(-(uint64_t)v);
+  }
+  else
+    Digits(v);
+}
+
+void sRESP::Fixed(int64_t v, uint8_t digits)
+{
+uint64_t u,p;
+uint8_t d;
+
+  Next();
+  if(v<0)
+  {
+    write('-');
+    u=-(uint64_t)v;
+  }
+  else
+    u=v;
+
+  for(p=1,d=0;d<digits;d++)
+    p*=10;
+
+  Digits(u/p);
+  if(digits)
+  {
+    write('.');
+    for(u%=p,p/=10;p;p/=10)
+      write('0'+(u/p)%10);
+  }
+}
+
+void sRESP::Str(const char *s)
+{
+  Next();
+  write((const uint8_t *)s,strlen(s));
+}
+
+void sRESP::Next(void)
+{
+  if(Values)
+    write(',');
+  else
+  {
+    if(Units)
+      write(';');
+    Units++;
+  }
+  Values++;
+}
+
+void sRESP::Begin(void)
+{
+  Values = 0;
+}
+
+void sRESP::End(void)
+{
+  if(Units)
+    write((const uint8_t *)"\r\n",2);
+  Units = Values = 0;
+}
+
+void sRESP::Drain(void)
+{
+int room;
+uint16_t n;
+
+  while(Head!=Tail)
+  {
+    room = Serial.availableForWrite();
+    if(room<=0)
+      return;
+
+    // up to the end of the ring at most, the rest next time round
+    n = (uint16_t)(Head-Tail);
+    if(n>RESP_TX_SIZE-(Tail & (RESP_TX_SIZE-1)))
+      n = RESP_TX_SIZE-(Tail & (RESP_TX_SIZE-1));
+    if(n>room)
+      n = room;
+    Serial.write(&Ring[Tail & (RESP_TX_SIZE-1)],n);
+    Tail += n;
+  }
+}
+
+void sRESP::Flush(void)
+{
+uint16_t n;
+
+  while(Head!=Tail)
+  {
+    n = (uint16_t)(Head-Tail);
+    if(n>RESP_TX_SIZE-(Tail & (RESP_TX_SIZE-1)))
+      n = RESP_TX_SIZE-(Tail & (RESP_TX_SIZE-1));
+    Serial.write(&Ring[Tail & (RESP_TX_SIZE-1)],n);
+    Tail += n;
+  }
+}
+
+bool sRESP::Pending(void)
+{
+  return Head!=Tail || Units;
+}
+
+size_t sRESP::write(uint8_t c)
+{
+  if((uint16_t)(Head-Tail)>=RESP_TX_SIZE)
+  {
+    Stalls++;
+    Flush();
+  }
+  Ring[Head++ & (RESP_TX_SIZE-1)] = c;
+  return 1;
+}
+
+size_t sRESP::write(const uint8_t *buf, size_t len)
+{
+size_t i;
+
+  for(i=0;i<len;i++)
+    write(buf[i]);
+  return len;
+}
+
+/* Private Functions ============================================================*/
+
+void sRESP::Digits(uint64_t v)
+{
+char text[20];          // 2^64 has 20 digits
+uint32_t w;
+uint8_t n;
+
+  // 64 bit division only for what doesn't fit in 32
+  n = 0;
+  while(v>0xFFFFFFFF)
+  {
+    text[n++] = '0' + v%10;
+    v /= 10;
+  }
+  w = v;
+  do
+  {
+    text[n++] = '0' + w%10;
+    w /= 10;
+  } while(w);
+
+  while(n)
+    write(text[--n]);
+}
+
+#endif
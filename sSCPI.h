@@ -6,336 +6,843 @@ Simple SCPI Parser
 
   Define this based on data size needed and available memory
 */
-#define PARAM_MAX		16
-#define GROUP_MAX		16
+#define NODE_MAX		96    // header nodes, every mnemonic of every command
+#define HASH_SIZE		256   // header lookup slots, power of 2, about 2*NODE_MAX
 #define CMD_LEN_MAX	32
-#define ERR_MAX     8
+#define TOKEN_LEN_MAX	12    // longest mnemonic or keyword, 12 per SCPI
+#define ERR_MAX     16    // error queue, power of 2, the last entry is for overflow
 /*
 
 
 \* ----------------------------------------------------------------------------- */
+#ifndef _SSCPI_H
+#define _SSCPI_H
+
+#include "sTRACE.h"
+#include "sRESP.h"
+#include "sSTATUS.h"
+
+// Error numbers: SCPI's own are negative, by class in the hundreds
+// (-1xx command, -2xx execution, -3xx device, -4xx query). The device's
+// are positive: 1xx execution, 2xx hardware. Texts are in scpiErrors
+enum ScpiErrorCode
+{
+  ERR_NONE              = 0,
+  ERR_PARAM_NOT_ALLOWED = -108,
+  ERR_UNDEFINED_HEADER  = -113,
+  ERR_SUFFIX_RANGE      = -114,
+  ERR_INVALID_NUMBER    = -121,
+  ERR_SUFFIX_NOT_ALLOWED= -138,
+  ERR_SETTINGS_CONFLICT = -221,
+  ERR_DATA_RANGE        = -222,
+  ERR_ILLEGAL_VALUE     = -224,
+  ERR_MASS_STORAGE      = -250,
+  ERR_QUEUE_OVERFLOW    = -350,
+  ERR_FREQ_RANGE        = 101,
+  ERR_POWER_RANGE       = 102,
+  ERR_UNCOMPUTABLE      = 103,
+  ERR_PLL_UNLOCK        = 201,
+  ERR_LOCK_TIMEOUT      = 202
+};
 
 class sSCPI
 {
+	friend class sBENCH;
+
 	public:
 		// Define callback function pointer type
-		typedef uint32_t (*func_t)(double,bool);
+		typedef uint32_t (*func_t)(int64_t,bool);
+
+		// Units a value can carry as a suffix
+		enum { UNIT_NONE, UNIT_HZ, UNIT_DBM, UNIT_S };
+
+		// How the values of a parameter are read: the function gets
+		// value*10^digits, rounded, in the base unit of unit. Power in dBm
+		// with 2 digits comes as centi-dBm, time in s with 6 digits as us.
+		// MIN, MAX and DEF stand for min, max and def
+		struct Number
+		{
+			uint8_t unit;
+			uint8_t digits;
+			int64_t min,max,def;
+		};
 		
 		sSCPI();
 		
+		// Names are SCPI mnemonics: the upper case part is the short form,
+		// the whole word the long one, and brackets make a node optional.
+		//   src = CreateGroup("[SOURce]",0);
+		//   RegisterParameter("FREQuency[:CW]",src,&func);
+		// accepts FREQ, FREQ:CW, SOURCE:FREQUENCY:CW, sour:freq...
+		// Any mnemonic may end in a numeric suffix, SOUR2:FREQ, see Suffix()
+		// Without a Number values are plain integers, ON or OFF.
+		// Queries answer through resp (sRESP.h), which joins the answers
+		// of one message into one line
 		uint8_t CreateGroup(char* name, uint8_t parent);
-		uint8_t RegisterParameter(char* command, uint8_t group, func_t function);
+		uint8_t RegisterParameter(char* command, uint8_t group, func_t function, const Number* number = 0);
 		void Parse(char byte);
-    void PushError(char* name);
-    void PullError(char* message);
+    // Error queue, first in first out. An error is queued as its number,
+    // a header node and the time; the text is only looked up when read.
+    // It sets its class bit in *ESR (sSTATUS.h). Once the queue is full
+    // the last entry is -350 and newer errors are dropped.
+    // node is the header it is about, 0 none; by default the one being
+    // handled, for command handlers. Tasks and interrupts pass 0: then
+    // it is safe from interrupts, never waits and keeps the order
+    enum { NODE_HANDLED = 0xFF };
+    void PushError(int16_t code, uint8_t node = NODE_HANDLED);
+    // Oldest error as SYST:ERR? has it: -222,"Data out of range;SOUR:FREQ 1234 ms"
+    void PullError(char* message, uint8_t size);
+    // *CLS
+    void ClearErrors(void);
+
+    // Position of the value being handled in a comma separated list
+    uint8_t ArgIndex(void);
+    // Numeric suffix of the header, as in SOURce2:FREQ, 1 when none
+    uint8_t Suffix(void);
 
 
 	private:
 		
-		struct GroupType
+		struct NodeType
 		{
-			uint8_t id;
-			uint8_t parentId;
-			const char* name;
-      //uint8_t len;
+			const char* name;   // points into the registered string, not terminated
+			uint8_t shortLen;
+			uint8_t longLen;
+			uint8_t parent;
+			bool optional;
+			func_t function;
+			const Number* number;
 		};
-		
-		struct ParameterType 
+
+		// One slot per spelling of a node, keyed by the node it is found under
+		struct SlotType
 		{
-			uint8_t id;			// Parameter ID. Should be larger than 0, value of 0 means unused.
-			uint8_t groupId;
-			char* name;
-			func_t function;
+			uint16_t tag;       // upper hash bits, rejects most slots without a compare
+			uint8_t node;       // 0 means empty
+			uint8_t parent;
+			uint8_t len;
 		};
 		
-		uint8_t grpIndex;
-		GroupType groups[GROUP_MAX];
-		ParameterType Parameters[PARAM_MAX];
-    char buffS[CMD_LEN_MAX];
-		uint8_t buffSidx;
-		uint8_t buffSptr;
-    uint8_t errIndex;
-    const char *ErrorMessage[ERR_MAX][CMD_LEN_MAX];
-
-		const char* GetGroupName(uint8_t index);
-		uint8_t GetGroupID(char* name);
-		uint8_t GetCommandID(char* name);
-    bool scanGroup(char* string, char *groupgot);
-    void scanCommand(char* string, char *commandgot);
-    void scanValue(char* string, char *paramgot);
+		NodeType Nodes[NODE_MAX];
+		uint8_t nodeCount;
+		SlotType Slots[HASH_SIZE];
+		uint8_t maxProbe;
+
+		// Tokenizer, one byte at a time. At the terminator the header is
+		// resolved and the last value is read; nothing is buffered or re-read
+		enum { ST_START, ST_HEADER, ST_QUERY, ST_VALUE, ST_SKIP };
+		enum { VAL_NONE, VAL_INT, VAL_FRAC, VAL_EXP, VAL_SUFFIX, VAL_WORD, VAL_BAD };
+		uint8_t state;
+		uint8_t node;         // resolved so far
+		uint32_t hash;        // of the mnemonic being read
+		uint8_t tokLen;
+		char token[TOKEN_LEN_MAX];
+		bool query;
+		uint8_t valState;
+		bool valNeg,expNeg;
+		uint64_t valMant;     // 18 digits at most
+		int16_t valScale;     // value = valMant * 10^(valScale +- valExp)
+		int16_t valExp;
+    uint8_t argIdx;
+    uint8_t suffix;
+
+    struct ErrorRecord
+    {
+      int16_t code;
+      uint8_t node;       // header being handled, 0 none
+      volatile bool ready;  // written, the reader may take it
+      uint32_t time;      // ms
+    };
+    ErrorRecord Errors[ERR_MAX];
+    volatile uint8_t errHead;   // entries taken, wraps
+    volatile uint8_t errTail;   // entries read, wraps
+    uint8_t errNode;            // header Call() is handling
+
+		uint8_t AddNodes(const char* path, uint8_t parent, func_t function, const Number* number);
+		uint8_t AddNode(const char* name, uint8_t len, uint8_t parent, bool optional);
+		void AddSlot(uint8_t node, uint8_t parent, uint8_t len);
+		void SetFunction(uint8_t node, func_t function, const Number* number);
+		uint8_t FindNode(uint8_t parent, const char* name, uint8_t len, uint32_t hash);
+		bool EndMnemonic(void);
+		void ValueStart(void);
+		void ValueChar(char c);
+		int16_t ValueEnd(const Number* num, int64_t* v);
+		void Call(void);
+		uint8_t HeaderName(uint8_t node, char* text, uint8_t size);
+
+		static uint32_t HashStart(uint8_t parent);
+		static uint32_t HashStep(uint32_t hash, char c);
+		static bool IsMnemonic(char c);
+		static uint8_t ErrorClass(int16_t code);
+		static const char* ErrorText(int16_t code);
+};
+
+// Value suffixes, as a power of ten of the unit. MHZ is mega, as SCPI has it
+struct ScpiSuffix
+{
+  const char *name;
+  uint8_t unit;
+  int8_t exp;
+};
+
+const ScpiSuffix scpiSuffix[] = {
+  {"HZ",sSCPI::UNIT_HZ,0}, {"KHZ",sSCPI::UNIT_HZ,3}, {"MHZ",sSCPI::UNIT_HZ,6}, {"GHZ",sSCPI::UNIT_HZ,9},
+  {"DBM",sSCPI::UNIT_DBM,0},
+  {"S",sSCPI::UNIT_S,0}, {"MS",sSCPI::UNIT_S,-3}, {"US",sSCPI::UNIT_S,-6}, {"NS",sSCPI::UNIT_S,-9}
+};
 
+// What SYST:ERR? says for each error number
+struct ScpiError
+{
+  int16_t code;
+  const char *text;
+};
+
+const ScpiError scpiErrors[] = {
+  {ERR_NONE,"No error"},
+  {ERR_PARAM_NOT_ALLOWED,"Parameter not allowed"}, {ERR_UNDEFINED_HEADER,"Undefined header"},
+  {ERR_SUFFIX_RANGE,"Header suffix out of range"}, {ERR_INVALID_NUMBER,"Invalid character in number"},
+  {ERR_SUFFIX_NOT_ALLOWED,"Suffix not allowed"}, {ERR_SETTINGS_CONFLICT,"Settings conflict"},
+  {ERR_DATA_RANGE,"Data out of range"}, {ERR_ILLEGAL_VALUE,"Illegal parameter value"},
+  {ERR_MASS_STORAGE,"Mass storage error"}, {ERR_QUEUE_OVERFLOW,"Queue overflow"},
+  {ERR_FREQ_RANGE,"Frequency out of range"}, {ERR_POWER_RANGE,"Power out of range"},
+  {ERR_UNCOMPUTABLE,"Uncomputable Frequency"},
+  {ERR_PLL_UNLOCK,"PLL Unlock"}, {ERR_LOCK_TIMEOUT,"PLL lock timeout"}
 };
 
 
 sSCPI::sSCPI()
 {
-	grpIndex = 1;
-	buffSidx = 0;
-  buffSidx = 0;
+	nodeCount = 1;      // node 0 is the root
+	state = ST_START;
+	maxProbe = 0;
 
-  errIndex = 0;
-  *ErrorMessage[0]=(char*)"No error";
+  argIdx = 0;
+  errHead = errTail = 0;
+  errNode = 0;
 }
 
 /* Public Functions =============================================================*/
 
 uint8_t sSCPI::CreateGroup(char* name, uint8_t parent)
 {
-	groups[grpIndex].id = grpIndex;
-	groups[grpIndex].name = name;
-	
-	if(grpIndex<GROUP_MAX)
-    grpIndex++;
-	
-	return grpIndex - 1;
+	return AddNodes(name, parent, 0, 0);
 }
 
 
-uint8_t sSCPI::RegisterParameter(char* command, uint8_t group, func_t function)
+uint8_t sSCPI::RegisterParameter(char* command, uint8_t group, func_t function, const Number* number)
 {
-	uint8_t newId = 1;
-	
-	// Find first available id that can be used
-	for (int i = 0; i < PARAM_MAX; i++)
-		if (Parameters[i].id == newId)
-		{
-			newId++;
-			i = 0;
-		}
-		
-	for (int i = 0; i < PARAM_MAX; i++)
-		if (Parameters[i].id == 0)
-		{
-			Parameters[i].id = newId;
-			Parameters[i].groupId = group;
-			Parameters[i].name = command;
-			Parameters[i].function = function;
-			break;
-		}
-	
-	return newId;
+	return AddNodes(command, group, function, number);
 }
 
 void sSCPI::Parse(char c)
 {
-	buffS[buffSidx] = c;
-	buffSidx++;
-  bool q=0;
-  
-	if ((c == '\r') || (c == '\n') || (c == ';'))
-	{
-		char group[10];
-		char command[16];
-		char paramValue[12];
-
-    buffS[buffSidx] = 0;
-
-    // cleanUp buffS
-    int s=c=0;
-    while( (buffS[s]==' ' || buffS[s]==':') && buffS[s] )
-      s++;
-
-    while( (buffS[s]!='\r' && buffS[s]!='\n' && buffS[s]!=';') && buffS[s] )
-      buffS[c++] = buffS[s++];
-
-    buffS[c]=0;
-    buffSptr=0;
-#ifdef DEBUG       
-Serial.print("dbg: -------------------[");Serial.print(buffS);Serial.println("]");
-#endif
-    group[0]=0;
-    scanGroup(buffS,group);
-#ifdef DEBUG       
-Serial.print("dbg:group[");Serial.print(group);Serial.println("]");
-#endif
-    command[0]=0;
-    scanCommand(buffS,command);
-#ifdef DEBUG       
-Serial.print("dbg:command[");Serial.print(command);Serial.println("]");
-#endif
-    paramValue[0]=0;
-    scanValue(buffS,paramValue);
-#ifdef DEBUG       
-Serial.print("dbg:param[");Serial.print(paramValue);Serial.println("]");
-#endif
+  if ((c == '\r') || (c == '\n') || (c == ';'))
+  {
+    switch(state)
+    {
+      case ST_HEADER:
+        if(EndMnemonic())
+          Call();
+        else
+          PushError(ERR_UNDEFINED_HEADER);
+        break;
+      case ST_QUERY:
+      case ST_VALUE:
+        Call();
+        break;
+      case ST_SKIP:
+        PushError(ERR_UNDEFINED_HEADER);
+        break;
+    }
+    state = ST_START;
+    if(c!=';')
+      resp.End();         // message done: its responses are one line
+    return;
+  }
 
+  switch(state)
+  {
+    case ST_START:            // blanks and a leading colon
+      if(c==' ' || c==':')
+        return;
+      state = ST_HEADER;
+      node = 0;
+      hash = HashStart(0);
+      tokLen = 0;
+      query = 0;
+      argIdx = 0;
+      suffix = 1;
+      ValueStart();
+      if(c=='*')              // common command, "*" is a node of its own
+      {
+        token[tokLen++] = c;
+        hash = HashStep(hash,c);
+        if(!EndMnemonic())
+          state = ST_SKIP;
+        return;
+      }
+      // no break
 
-		uint8_t grpId = GetGroupID(group);
-		uint8_t cmdId = GetCommandID(command);
-			
-		if (cmdId > 0)
-		{
-			for (int i = 0; i < PARAM_MAX; i++)
+    case ST_HEADER:
+      if(IsMnemonic(c))
       {
-				if ((Parameters[i].groupId == grpId) && (Parameters[i].id == cmdId))
-				{	
-  				// evaluate parameter
-          double v;
-					if(!strncmp(paramValue,"ON",2))
-						v = 1;
-					else if(!strncmp(paramValue,"OF",2))
-						v = 0;
-					else
-						v = strtod(paramValue, NULL);
-
-          if(!strcmp(paramValue,"?"))
-            q=1;
-
-          Parameters[i].function(v,q);
-				}
+        if(tokLen<TOKEN_LEN_MAX)
+        {
+          token[tokLen++] = c;
+          hash = HashStep(hash,c);
+        }
+        else
+          state = ST_SKIP;    // too long for any node
       }
-		}	
-		else
-    {
-      PushError((char *)"Invalid parameter"); // enqueue error
-    }
-		
-		// Reset commands builder index
-		buffSidx = 0;
-    //buffS[0]=0;
-	}
+      else if(c==':' || c==' ' || c=='?')
+      {
+        if(!EndMnemonic())
+          state = ST_SKIP;
+        else if(c=='?')
+        {
+          query = 1;
+          state = ST_QUERY;
+        }
+        else if(c==' ')
+          state = ST_VALUE;
+      }
+      else
+        state = ST_SKIP;
+      break;
+
+    case ST_VALUE:
+      if(c==',')              // one call per value of a list
+      {
+        Call();
+        argIdx++;
+        ValueStart();
+      }
+      else
+        ValueChar(c);
+      break;
+
+    default:                  // ST_QUERY, ST_SKIP: up to the terminator
+      break;
+  }
+}
+
+void sSCPI::PushError(int16_t code, uint8_t node)
+{
+ErrorRecord *e;
+uint8_t n,i;
+
+  if(node==NODE_HANDLED)
+    node = errNode;
+  Trace(TRACE_ERR, TR_SCPI_ERR, (int32_t)code, node);
+  status.Event(ErrorClass(code));
+
+  // take an entry: a few instructions with interrupts off, whoever gets
+  // in first is first in the queue
+  noInterrupts();
+  n = errHead-errTail;
+  i = errHead;
+  if(n<ERR_MAX)
+    errHead++;
+  status.Errors(1);
+  interrupts();
+
+  if(n>=ERR_MAX)
+    return;               // full, -350 already last
+  if(n==ERR_MAX-1)
+    code = ERR_QUEUE_OVERFLOW;
+
+  // then fill it in, marked ready last
+  e = &Errors[i & (ERR_MAX-1)];
+  e->code = code;
+  e->node = node;
+  e->time = millis();
+  e->ready = 1;
 }
 
-void sSCPI::PushError(char* name)
+void sSCPI::PullError(char* message, uint8_t size)
 {
-char text[32];
+ErrorRecord *e;
+char head[CMD_LEN_MAX];
+int16_t code;
+
+  // an entry still being written counts as not there yet
+  e = &Errors[errTail & (ERR_MAX-1)];
+  if(errTail==errHead || !e->ready)
+  {
+    snprintf(message,size,"%d,\"%s\"",ERR_NONE,ErrorText(ERR_NONE));
+    return;
+  }
 
-  if(errIndex<ERR_MAX)
-    ++errIndex;
+  code = e->code;
+  HeaderName(e->node,head,sizeof(head));
+  snprintf(message,size,"%d,\"%s;%s%s%lu ms\"",code,ErrorText(code),
+    head,*head ? " " : "",(unsigned long)e->time);
 
-  *ErrorMessage[errIndex]=(char*)name;
-#ifdef DEBUG
-Serial.print("***[ERROR] set to ");Serial.println(*ErrorMessage[errIndex]);
-#endif
+  e->ready = 0;
+  noInterrupts();
+  errTail++;
+  status.Errors(errTail!=errHead);
+  interrupts();
 }
 
-void sSCPI::PullError(char* message)
+void sSCPI::ClearErrors(void)
 {
-  sprintf((char*)message,"+%d,\"%s\"",errIndex,*ErrorMessage[errIndex]);
+  noInterrupts();
+  while(errTail!=errHead && Errors[errTail & (ERR_MAX-1)].ready)
+    Errors[errTail++ & (ERR_MAX-1)].ready = 0;
+  status.Errors(errTail!=errHead);
+  interrupts();
+}
 
-  if(errIndex!=0)
-    errIndex--;
+uint8_t sSCPI::ArgIndex(void)
+{
+  return argIdx;
+}
 
+uint8_t sSCPI::Suffix(void)
+{
+  return suffix;
 }
 
 /* Private Functions ============================================================*/
 
-const char* sSCPI::GetGroupName(uint8_t index)
+// Walk a registered path, "[SOURce]" or "FREQuency[:CW]", creating the
+// nodes missing under parent. Returns the last node.
+uint8_t sSCPI::AddNodes(const char* path, uint8_t parent, func_t function, const Number* number)
 {
-	return groups[index].name;
+uint8_t node,len;
+bool optional;
+
+  node=parent;
+  while(*path)
+  {
+    optional=0;
+    while(*path=='[' || *path==':' || *path==']')
+    {
+      if(*path=='[')
+        optional=1;
+      path++;
+    }
+    for(len=0;IsMnemonic(path[len]);len++)
+      ;
+    if(!len)
+      break;
+
+    node=AddNode(path,len,node,optional);
+    if(!node)
+      return 0;
+    path+=len;
+  }
+
+  if(function)
+    SetFunction(node,function,number);
+
+  return node;
 }
 
+uint8_t sSCPI::AddNode(const char* name, uint8_t len, uint8_t parent, bool optional)
+{
+NodeType *n;
+uint8_t i,id;
+
+  // already there, from another command of the same branch
+  for(i=1;i<nodeCount;i++)
+    if(Nodes[i].parent==parent && Nodes[i].longLen==len && !strncmp(Nodes[i].name,name,len))
+      return i;
 
-uint8_t sSCPI::GetGroupID(char* name)
+  if(nodeCount>=NODE_MAX)
+  {
+    Trace(TRACE_ERR, TR_NODE_FULL);
+    return 0;
+  }
+
+  id=nodeCount++;
+  n=&Nodes[id];
+  n->name=name;
+  n->longLen=len;
+  for(n->shortLen=0;n->shortLen<len && !islower(name[n->shortLen]);n->shortLen++)
+    ;
+  n->parent=parent;
+  n->optional=optional;
+  n->function=0;
+  n->number=0;
+
+  AddSlot(id,parent,n->longLen);
+  if(n->shortLen!=n->longLen)
+    AddSlot(id,parent,n->shortLen);
+
+  // a child of an optional node is also found right under its grandparent
+  if(parent && Nodes[parent].optional)
+  {
+    AddSlot(id,Nodes[parent].parent,n->longLen);
+    if(n->shortLen!=n->longLen)
+      AddSlot(id,Nodes[parent].parent,n->shortLen);
+  }
+
+  return id;
+}
+
+// Open addressing, linear probe. Nothing is ever removed, so an empty slot
+// ends every search and the longest probe bounds it.
+void sSCPI::AddSlot(uint8_t node, uint8_t parent, uint8_t len)
 {
-int i;
+uint32_t h;
+uint8_t i,p;
+
+  h=HashStart(parent);
+  for(i=0;i<len;i++)
+    h=HashStep(h,Nodes[node].name[i]);
 
-	for (i = 0; i < GROUP_MAX; i++)
+  for(p=0;p<HASH_SIZE/2;p++)
   {
-		//if (strncmp(name, groups[i].name, groups[i].len) == 0)
-    //if (strcmp(name, groups[i].name) == 0)
-    if (strncmp(name, groups[i].name, strlen(groups[i].name)) == 0)
+    i=(h+p)&(HASH_SIZE-1);
+    if(!Slots[i].node)
     {
-			return groups[i].id;
+      Slots[i].tag=h>>16;
+      Slots[i].node=node;
+      Slots[i].parent=parent;
+      Slots[i].len=len;
+      if(p>maxProbe)
+        maxProbe=p;
+      return;
     }
-  }	
-  PushError((char *)"Undefined header");
-	return 0;
+  }
+  Trace(TRACE_ERR, TR_HASH_FULL);
+}
+
+// An optional last node hands its function to its parent: FREQ[:CW]
+void sSCPI::SetFunction(uint8_t node, func_t function, const Number* number)
+{
+  do
+  {
+    if(!Nodes[node].function)
+    {
+      Nodes[node].function=function;
+      Nodes[node].number=number;
+    }
+    if(!Nodes[node].optional)
+      break;
+    node=Nodes[node].parent;
+  } while(node);
 }
 
+uint8_t sSCPI::FindNode(uint8_t parent, const char* name, uint8_t len, uint32_t hash)
+{
+SlotType *s;
+const char *a;
+uint8_t i,p;
+
+  for(p=0;p<=maxProbe;p++)
+  {
+    s=&Slots[(hash+p)&(HASH_SIZE-1)];
+    if(!s->node)
+      return 0;
+    if(s->tag!=(uint16_t)(hash>>16) || s->parent!=parent || s->len!=len)
+      continue;
+
+    a=Nodes[s->node].name;
+    for(i=0;i<len && toupper(a[i])==toupper(name[i]);i++)
+      ;
+    if(i==len)
+      return s->node;
+  }
+  return 0;
+}
 
-uint8_t sSCPI::GetCommandID(char* name)
+// The mnemonic just read is a child of node. False when it is not
+bool sSCPI::EndMnemonic(void)
 {
-int i;
+uint32_t h;
+uint8_t n,len,i;
 
-	for (i = 0; i < PARAM_MAX; i++)
+  if(tokLen)
   {
-		if (strcmp(name, Parameters[i].name) == 0)
+    n = FindNode(node,token,tokLen,hash);
+
+    // not a node as it is: a node and a numeric suffix, SOURce2
+    for(len=tokLen;!n && len>1 && isdigit(token[len-1]);len--)
+      ;
+    if(!n && len<tokLen && tokLen-len<=2)
     {
-			return Parameters[i].id;
+      h = HashStart(node);
+      for(i=0;i<len;i++)
+        h = HashStep(h,token[i]);
+      n = FindNode(node,token,len,h);
+      if(n)
+      {
+        suffix = 0;
+        for(i=len;i<tokLen;i++)
+          suffix = suffix*10 + token[i]-'0';
+      }
     }
+
+    node = n;
+    if(!node)
+      return 0;
   }
-  PushError((char *)"Unknown command");	
-	return 0;
+  hash = HashStart(node);
+  tokLen = 0;
+  return 1;
 }
 
+void sSCPI::ValueStart(void)
+{
+  valState = VAL_NONE;
+  valNeg = expNeg = 0;
+  valMant = 0;
+  valScale = valExp = 0;
+  tokLen = 0;
+}
 
-bool sSCPI::scanGroup(char *string, char *groupgot)
+// NR1/NR2/NR3 numbers with an optional suffix, or a keyword, in token
+void sSCPI::ValueChar(char c)
 {
-int s,c;
+uint8_t d;
 
-#ifdef DEBUG
-Serial.print("scGrp>>");Serial.println(&string[buffSptr]);
-#endif
-  s=0;c=0;
+  d = c-'0';
+  switch(valState)
+  {
+    case VAL_NONE:
+      if(c==' ')
+        break;
+      if(c=='-' || c=='+')
+      {
+        valNeg = c=='-';
+        valState = VAL_INT;
+      }
+      else if(d<10 || c=='.')
+      {
+        valState = VAL_INT;
+        ValueChar(c);
+      }
+      else if(isalpha(c))
+      {
+        valState = VAL_WORD;
+        ValueChar(c);
+      }
+      else
+        valState = VAL_BAD;
+      break;
+
+    case VAL_INT:
+    case VAL_FRAC:
+      if(d<10)
+      {
+        if(valMant<100000000000000000ULL)
+        {
+          valMant = valMant*10 + d;
+          if(valState==VAL_FRAC)
+            valScale--;
+        }
+        else if(valState==VAL_INT)
+          valScale++;         // digits past 18 only scale
+      }
+      else if(c=='.' && valState==VAL_INT)
+        valState = VAL_FRAC;
+      else if(c=='e' || c=='E')
+        valState = VAL_EXP;
+      else
+      {
+        valState = VAL_SUFFIX;
+        ValueChar(c);
+      }
+      break;
+
+    case VAL_EXP:
+      if(d<10)
+      {
+        if(valExp<1000)
+          valExp = valExp*10 + d;
+      }
+      else if((c=='-' || c=='+') && !valExp)
+        expNeg = c=='-';
+      else
+      {
+        valState = VAL_SUFFIX;
+        ValueChar(c);
+      }
+      break;
+
+    case VAL_SUFFIX:
+    case VAL_WORD:
+      if(c==' ')
+        break;
+      if(isalpha(c) && tokLen<TOKEN_LEN_MAX)
+        token[tokLen++] = toupper(c);
+      else
+        valState = VAL_BAD;
+      break;
+  }
+}
+
+// The value read, as the integer the node's function takes. Returns the
+// error, 0 if none
+int16_t sSCPI::ValueEnd(const Number* num, int64_t* v)
+{
+uint64_t u,p;
+int16_t e;
+uint8_t i;
+
+  e = num ? num->digits : 0;
+  token[tokLen] = 0;
 
-  if(string[buffSptr]=='*')
+  switch(valState)
   {
-    groupgot[c]='*';groupgot[++c]=0;
-    //string += sizeof(char);
-    buffSptr=c;
-    return true;
+    case VAL_NONE:            // no value, as in a query
+      *v = 0;
+      return 0;
+
+    case VAL_WORD:
+      if(num && (!strcmp(token,"MIN") || !strcmp(token,"MINIMUM")))
+        *v = num->min;
+      else if(num && (!strcmp(token,"MAX") || !strcmp(token,"MAXIMUM")))
+        *v = num->max;
+      else if(num && (!strcmp(token,"DEF") || !strcmp(token,"DEFAULT")))
+        *v = num->def;
+      else if(!num && !strcmp(token,"ON"))
+        *v = 1;
+      else if(!num && !strcmp(token,"OFF"))
+        *v = 0;
+      else
+        return ERR_ILLEGAL_VALUE;
+      return 0;
+
+    case VAL_BAD:
+      return ERR_INVALID_NUMBER;
   }
-  else
+
+  if(tokLen)
+  {
+    for(i=0;i<sizeof(scpiSuffix)/sizeof(scpiSuffix[0]);i++)
+      if(!strcmp(token,scpiSuffix[i].name))
+        break;
+    if(!num || !num->unit)
+      return ERR_SUFFIX_NOT_ALLOWED;
+    if(i==sizeof(scpiSuffix)/sizeof(scpiSuffix[0]) || scpiSuffix[i].unit!=num->unit)
+      return ERR_ILLEGAL_VALUE;
+    e += scpiSuffix[i].exp;
+  }
+
+  // value*10^e, rounded half away from zero
+  e += valScale + (expNeg ? -valExp : valExp);
+  u = valMant;
+  for(;e>0 && u;e--)
   {
-     while( /*string[buffSptr]!=' ' &&*/ string[buffSptr]!=':' && 
-            (string[buffSptr]!='\r' && string[buffSptr]!='\n' && string[buffSptr]) )
-        groupgot[c++]=string[buffSptr++];
-    groupgot[c]=0;
-    //string += (sizeof(char)*s);
-    buffSptr++;
-    //buffSptr=s;
-    return true;   
+    if(u>(uint64_t)INT64_MAX/10)
+      return ERR_DATA_RANGE;
+    u *= 10;
+  }
+  if(e<0)
+  {
+    if(e<-18)
+      u = 0;
+    else
+    {
+      for(p=1;e<0;e++)
+        p *= 10;
+      u = (u + p/2)/p;
+    }
   }
-  return false;
+
+  *v = valNeg ? -(int64_t)u : (int64_t)u;
+  return 0;
 }
 
-void sSCPI::scanCommand(char* string, char *commandgot)
+// Hand the value read to the node's function
+void sSCPI::Call(void)
 {
-int s,c;
+int16_t err;
+int64_t v;
 
-#ifdef DEBUG
-Serial.print("scCmd>>");Serial.println(&string[buffSptr]);
-#endif
-  s=c=0;
+  if(!Nodes[node].function)
+  {
+    PushError(ERR_UNDEFINED_HEADER);
+    return;
+  }
 
-  if(string[buffSptr]==' ')
+  errNode = node;
+  err = ValueEnd(Nodes[node].number,&v);
+  if(err)
   {
-    commandgot[c]=0;
-    buffSptr++;
+    PushError(err);
+    errNode = 0;
     return;
   }
 
-  while( string[buffSptr]!=' ' && string[buffSptr]!='?' &&
-        (string[buffSptr]!='\r' && string[buffSptr]!='\n' && string[buffSptr]) )
-    commandgot[c++]=string[buffSptr++];
-  commandgot[c]=0;
-  //string += sizeof(char)*c;
-  buffSptr++;
-  //buffSptr=s;
+  if(query)
+  {
+    Trace(TRACE_CMD, TR_SCPI_QRY, node);
+    resp.Begin();
+  }
+  else
+    Trace(TRACE_CMD, TR_SCPI_SET, node, (int32_t)v);
+  Nodes[node].function(v,query);
+  errNode = 0;
 }
 
-void sSCPI::scanValue(char* string, char *paramgot)
+// Short form path of a node, "SOUR:FREQ". Returns its length
+uint8_t sSCPI::HeaderName(uint8_t node, char* text, uint8_t size)
 {
-int s,c;
+uint8_t n;
 
-#ifdef DEBUG
-Serial.print("scVal>>");Serial.println(&string[buffSptr]);
-#endif
-  s=c=0;
+  if(!node || !size)
+  {
+    if(size)
+      *text=0;
+    return 0;
+  }
 
-//    while((string[buffSptr]!=' ' || string[buffSptr]!='?') && string[buffSptr])
-//     buffSptr++;
+  n=HeaderName(Nodes[node].parent,text,size);
+  if(n && text[n-1]!='*' && n<size-1)
+    text[n++]=':';
+  if(n+Nodes[node].shortLen<size)
+  {
+    memcpy(&text[n],Nodes[node].name,Nodes[node].shortLen);
+    n+=Nodes[node].shortLen;
+  }
+  text[n]=0;
+  return n;
+}
 
-    if(string[buffSptr]=='?')
-      buffSptr++;
-    else
-      buffSptr--;
+// FNV-1a, upper cased, seeded with the parent node
+uint32_t sSCPI::HashStart(uint8_t parent)
+{
+  return (2166136261UL ^ parent) * 16777619UL;
+}
 
-    while( ( string[buffSptr]!='\r' || string[buffSptr]!='\n' || string[buffSptr]!=':') && string[buffSptr] )
-      paramgot[c++]=string[buffSptr++];
+uint32_t sSCPI::HashStep(uint32_t hash, char c)
+{
+  return (hash ^ (uint8_t)toupper(c)) * 16777619UL;
+}
 
-    paramgot[c]=0;
+bool sSCPI::IsMnemonic(char c)
+{
+  return isalnum(c) || c=='*' || c=='_';
 }
 
+// *ESR bit for an error, by its number
+uint8_t sSCPI::ErrorClass(int16_t code)
+{
+  if(code<=-400)
+    return ESR_QYE;
+  if(code<=-300 || code>=200)
+    return ESR_DDE;
+  if(code<=-200 || code>0)
+    return ESR_EXE;
+  if(code<0)
+    return ESR_CME;
+  return 0;
+}
 
+const char* sSCPI::ErrorText(int16_t code)
+{
+uint8_t i;
+
+  for(i=0;i<sizeof(scpiErrors)/sizeof(scpiErrors[0]);i++)
+    if(scpiErrors[i].code==code)
+      return scpiErrors[i].text;
+  return "Device-specific error";
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------------*\
+Simple IEEE 488.2 / SCPI Status registers
+(c,2003 luis-es)
+
+  The status byte and what feeds it, kept up to date by the events
+  themselves: errors as they are queued, lock detect from its interrupt,
+  sweeps and hops as they start and stop. Nothing is polled to build
+  them, so *STB? is one read that tells it all.
+
+  STATus:OPERation and STATus:QUEStionable have three registers each:
+    CONDition   what is going on now
+    EVENt       bits that went 0 to 1 since it was last read
+    ENABle      which EVENt bits make its summary bit in *STB
+  *ESR holds the standard events (operation complete, errors by class,
+  power on) and *ESE picks the ones summarized in *STB. *SRE picks the
+  *STB bits that set the master summary, bit 6.
+
+  Condition() and Event() may be called from interrupts.
+
+  Define this based on instrument features
+*/
+#define STAT_OPER_SETTLING  0x0002    // a channel waiting for lock after a retune
+#define STAT_OPER_SWEEPING  0x0008    // sweep or list running
+#define STAT_OPER_LOCKED    0x0100    // every channel locked
+#define STAT_OPER_HOPPING   0x0200    // hop sequence running
+#define STAT_QUES_FREQ      0x0020    // a channel lost lock
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SSTATUS_H
+#define _SSTATUS_H
+
+#include "sRESP.h"
+
+// *ESR bits
+#define ESR_OPC   0x01      // operation complete, *OPC
+#define ESR_QYE   0x04      // query error
+#define ESR_DDE   0x08      // device dependent error
+#define ESR_EXE   0x10      // execution error
+#define ESR_CME   0x20      // command error
+#define ESR_PON   0x80      // power on
+
+// *STB bits
+#define STB_EAV   0x04      // error queue not empty
+#define STB_QUES  0x08      // questionable summary
+#define STB_MAV   0x10      // message available
+#define STB_ESB   0x20      // standard event summary
+#define STB_MSS   0x40      // master summary
+#define STB_OPER  0x80      // operation summary
+
+class sSTATUS
+{
+	friend class sBENCH;
+
+	public:
+		sSTATUS();
+
+		enum { OPER, QUES, REGS };
+
+		// Condition bits of reg in mask become value; the ones going 0 to
+		// 1 latch into the event register
+		void Condition(uint8_t reg, uint16_t mask, uint16_t value);
+		// Same, for a caller that already has interrupts off
+		void ConditionLocked(uint8_t reg, uint16_t mask, uint16_t value);
+		uint16_t GetCondition(uint8_t reg);
+		// Event register of reg, cleared by reading
+		uint16_t ReadEvent(uint8_t reg);
+		uint16_t Enable[REGS];
+
+		// Standard event bits, ESR_
+		void Event(uint8_t bits);
+		// *ESR?, cleared by reading
+		uint8_t ReadESR(void);
+		uint8_t ESE;          // *ESE, standard events to the status byte
+		uint8_t SRE;          // *SRE, status byte bits to the master summary
+
+		// Error queue not empty, from the parser
+		void Errors(bool any);
+		// *STB?
+		uint8_t STB(void);
+
+		// *CLS: all event registers, not the enables
+		void Clear(void);
+		// STAT:PRES: enables to their defaults
+		void Preset(void);
+
+	private:
+		volatile uint16_t Cond[REGS];
+		volatile uint16_t Even[REGS];
+		volatile uint8_t ESR;
+		bool EAV;
+};
+
+sSTATUS status;
+
+
+sSTATUS::sSTATUS()
+{
+uint8_t r;
+
+  for(r=0;r<REGS;r++)
+    Cond[r] = Even[r] = 0;
+  ESR = ESR_PON;
+  EAV = 0;
+  ESE = SRE = 0;
+  Preset();
+}
+
+/* Public Functions =============================================================*/
+
+void sSTATUS::Condition(uint8_t reg, uint16_t mask, uint16_t value)
+{
+  noInterrupts();
+  ConditionLocked(reg, mask, value);
+  interrupts();
+}
+
+void sSTATUS::ConditionLocked(uint8_t reg, uint16_t mask, uint16_t value)
+{
+uint16_t was;
+
+  was = Cond[reg];
+  Cond[reg] = (was & ~mask) | (value & mask);
+  Even[reg] |= Cond[reg] & ~was;
+}
+
+uint16_t sSTATUS::GetCondition(uint8_t reg)
+{
+  return Cond[reg];
+}
+
+uint16_t sSTATUS::ReadEvent(uint8_t reg)
+{
+uint16_t v;
+
+  noInterrupts();
+  v = Even[reg];
+  Even[reg] = 0;
+  interrupts();
+  return v;
+}
+
+void sSTATUS::Event(uint8_t bits)
+{
+  noInterrupts();
+  ESR |= bits;
+  interrupts();
+}
+
+uint8_t sSTATUS::ReadESR(void)
+{
+uint8_t v;
+
+  noInterrupts();
+  v = ESR;
+  ESR = 0;
+  interrupts();
+  return v;
+}
+
+void sSTATUS::Errors(bool any)
+{
+  EAV = any;
+}
+
+uint8_t sSTATUS::STB(void)
+{
+uint8_t stb;
+
+  stb = 0;
+  if(EAV)
+    stb |= STB_EAV;
+  if(Even[QUES] & Enable[QUES])
+    stb |= STB_QUES;
+  if(resp.Pending())
+    stb |= STB_MAV;
+  if(ESR & ESE)
+    stb |= STB_ESB;
+  if(Even[OPER] & Enable[OPER])
+    stb |= STB_OPER;
+  if(stb & SRE)
+    stb |= STB_MSS;
+  return stb;
+}
+
+void sSTATUS::Clear(void)
+{
+uint8_t r;
+
+  noInterrupts();
+  for(r=0;r<REGS;r++)
+    Even[r] = 0;
+  ESR = 0;
+  interrupts();
+}
+
+void sSTATUS::Preset(void)
+{
+  Enable[OPER] = 0;
+  Enable[QUES] = 0;
+}
+
+#endif
@@ -0,0 +1,322 @@
+/*------------------------------------------------------------------------------*\
+Simple non-volatile Store of numbered slots, in flash
+(c,2003 luis-es)
+
+  Each Save() appends a record, one flash page, to a log kept in the last
+  STORE_ROWS rows of flash; the newest valid record of a slot is its
+  content. Writes go round the whole area, so every row wears the same:
+
+    | Seq | Slot | Len | data, STORE_DATA bytes | CRC-32 |
+
+  The row after the one being written is always kept erased. When the log
+  gets there, the records still current in the row after that are copied
+  forward before it is erased, so a power loss at any point leaves every
+  slot readable: at worst a record is there twice, and the higher Seq
+  wins. A torn write fails its CRC and is ignored.
+
+  Begin() scans the area once and indexes the slots, so a Load() is one
+  flash read.
+
+  Flash is the SAMD21 NVM (64 byte pages, 4 to a row), or the file backed
+  stand-in on the host build. On any other core there is no store.
+
+  Define this based on available flash and slots
+*/
+#define STORE_SLOTS     16        // 0..15
+#define STORE_ROWS      16        // 256 bytes each, 4 records
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SSTORE_H
+#define _SSTORE_H
+
+#define STORE_REC_LEN   64        // one flash page
+#define STORE_ROW_RECS  4
+#define STORE_ROW_LEN   (STORE_REC_LEN*STORE_ROW_RECS)
+#define STORE_RECS      (STORE_ROWS*STORE_ROW_RECS)
+#define STORE_DATA      52
+#define STORE_BLANK     0xFFFFFFFF
+
+#if defined(ARDUINO_ARCH_SAMD)
+#define STORE_BASE      (FLASH_SIZE - STORE_ROWS*STORE_ROW_LEN)
+#elif defined(ARDUINO_HOST)
+#define STORE_BASE      (HOST_FLASH_SIZE - STORE_ROWS*STORE_ROW_LEN)
+#endif
+
+struct StoreRecord
+{
+  uint32_t Seq;           // STORE_BLANK when the page is erased
+  uint8_t  Slot;
+  uint8_t  Len;
+  uint16_t _res;
+  uint8_t  Data[STORE_DATA];
+  uint32_t CRC;           // CRC-32 of all the above
+};
+
+class sSTORE
+{
+	public:
+		sSTORE();
+
+		// Scan the flash. 0 if there is no store on this core
+		bool Begin(void);
+		// Write len bytes of data to slot. 0 on failure
+		bool Save(uint8_t slot, const void *data, uint8_t len);
+		// Read slot into data, up to len bytes. Returns the bytes read, 0 if
+		// the slot was never saved
+		uint8_t Load(uint8_t slot, void *data, uint8_t len);
+		bool Valid(uint8_t slot);
+
+		uint32_t Erases;      // rows erased since Begin()
+
+	private:
+		int16_t Index[STORE_SLOTS];   // record of each slot, -1 none
+		uint16_t Head;                // next record to write
+		uint32_t Seq;                 // last one written
+		bool Ready;
+
+		bool Read(uint16_t rec, StoreRecord *r);
+		void Write(uint16_t rec, StoreRecord *r);
+		void EraseRow(uint16_t row);
+		bool RowBlank(uint16_t row);
+		// Keep the row after Head's erased, moving its current records
+		void MakeSpare(void);
+		// Write r at Head with a new Seq, and index it. 0 if it didn't take
+		bool Put(StoreRecord *r);
+
+		static uint32_t CRC32(const uint8_t *data, uint16_t len);
+};
+
+
+sSTORE::sSTORE()
+{
+  Ready = 0;
+  Erases = 0;
+}
+
+/* Public Functions =============================================================*/
+
+bool sSTORE::Begin(void)
+{
+StoreRecord r;
+uint32_t top;
+uint16_t i,last;
+uint32_t seqOf[STORE_SLOTS];
+
+#if !defined(STORE_BASE)
+  return 0;
+#endif
+
+  for(i=0;i<STORE_SLOTS;i++)
+    Index[i] = -1;
+  Seq = 0;
+  top = 0;
+  last = STORE_RECS-1;
+
+  for(i=0;i<STORE_RECS;i++)
+  {
+    if(!Read(i,&r))
+    {
+      // any written page counts for the head, valid or torn
+      if(r.Seq!=STORE_BLANK && r.Seq>=top)
+      {
+        top = r.Seq;
+        last = i;
+      }
+      continue;
+    }
+    if(r.Seq>=top)
+    {
+      top = r.Seq;
+      last = i;
+    }
+    if(Index[r.Slot]<0 || r.Seq>seqOf[r.Slot])
+    {
+      Index[r.Slot] = i;
+      seqOf[r.Slot] = r.Seq;
+    }
+  }
+  Seq = top;
+
+  // go on writing at the first blank page after the newest one
+  Head = (last+1) % STORE_RECS;
+  for(i=0;i<STORE_RECS;i++)
+  {
+    Read(Head,&r);
+    if(r.Seq==STORE_BLANK)
+      break;
+    Head = (Head+1) % STORE_RECS;
+  }
+  if(i==STORE_RECS)
+  {
+    // no blank page at all: not ours, or never used
+    for(i=0;i<STORE_ROWS;i++)
+      EraseRow(i);
+    for(i=0;i<STORE_SLOTS;i++)
+      Index[i] = -1;
+    Head = 0;
+  }
+  Ready = 1;
+
+  MakeSpare();
+  return 1;
+}
+
+bool sSTORE::Save(uint8_t slot, const void *data, uint8_t len)
+{
+StoreRecord r;
+bool ok;
+
+  if(!Ready || slot>=STORE_SLOTS || len>STORE_DATA)
+    return 0;
+
+  memset(&r,0,sizeof(r));
+  r.Slot = slot;
+  r.Len = len;
+  memcpy(r.Data,data,len);
+  ok = Put(&r);
+  if(Head % STORE_ROW_RECS==0)
+    MakeSpare();
+  return ok;
+}
+
+uint8_t sSTORE::Load(uint8_t slot, void *data, uint8_t len)
+{
+StoreRecord r;
+
+  if(!Valid(slot) || !Read(Index[slot],&r))
+    return 0;
+
+  if(len>r.Len)
+    len = r.Len;
+  memcpy(data,r.Data,len);
+  return len;
+}
+
+bool sSTORE::Valid(uint8_t slot)
+{
+  return Ready && slot<STORE_SLOTS && Index[slot]>=0;
+}
+
+/* Private Functions ============================================================*/
+
+bool sSTORE::Put(StoreRecord *r)
+{
+bool ok;
+
+  r->Seq = ++Seq;
+  r->CRC = CRC32((const uint8_t *)r, sizeof(StoreRecord)-4);
+  Write(Head,r);
+
+  // read back: a bad page is skipped, the slot keeps its last good record
+  ok = Read(Head,r);
+  if(ok)
+    Index[r->Slot] = Head;
+
+  Head = (Head+1) % STORE_RECS;
+  return ok;
+}
+
+void sSTORE::MakeSpare(void)
+{
+StoreRecord r;
+uint16_t row,rec,i;
+
+  for(;;)
+  {
+    row = (Head/STORE_ROW_RECS + 1) % STORE_ROWS;
+    if(RowBlank(row))
+      return;
+
+    // records still current in there go on at the head, then it's erased.
+    // A full row of them fills the head row: the erased one becomes the
+    // head row, and the one after it is next
+    for(i=0;i<STORE_ROW_RECS && Head/STORE_ROW_RECS!=row;i++)
+    {
+      rec = row*STORE_ROW_RECS + i;
+      if(Read(rec,&r) && Index[r.Slot]==rec)
+        Put(&r);
+    }
+    EraseRow(row);
+  }
+}
+
+bool sSTORE::RowBlank(uint16_t row)
+{
+StoreRecord r;
+uint16_t i;
+
+  for(i=0;i<STORE_ROW_RECS;i++)
+  {
+    Read(row*STORE_ROW_RECS + i,&r);
+    if(r.Seq!=STORE_BLANK)
+      return 0;
+  }
+  return 1;
+}
+
+bool sSTORE::Read(uint16_t rec, StoreRecord *r)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  memcpy(r,(const void *)(STORE_BASE + rec*STORE_REC_LEN),sizeof(StoreRecord));
+#elif defined(ARDUINO_HOST)
+  HostFlashRead(STORE_BASE + rec*STORE_REC_LEN,r,sizeof(StoreRecord));
+#else
+  r->Seq = STORE_BLANK;
+  return 0;
+#endif
+
+  return r->Seq!=STORE_BLANK && r->Slot<STORE_SLOTS && r->Len<=STORE_DATA &&
+    r->CRC==CRC32((const uint8_t *)r, sizeof(StoreRecord)-4);
+}
+
+void sSTORE::Write(uint16_t rec, StoreRecord *r)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+volatile uint32_t *dst;
+const uint32_t *src;
+uint8_t i;
+
+  dst = (volatile uint32_t *)(STORE_BASE + rec*STORE_REC_LEN);
+  src = (const uint32_t *)r;
+
+  NVMCTRL->CTRLB.bit.MANW = 1;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+  for(i=0;i<STORE_REC_LEN/4;i++)
+    *dst++ = *src++;
+  NVMCTRL->ADDR.reg = (STORE_BASE + rec*STORE_REC_LEN)/2;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+#elif defined(ARDUINO_HOST)
+  HostFlashWrite(STORE_BASE + rec*STORE_REC_LEN,r,sizeof(StoreRecord));
+#endif
+}
+
+void sSTORE::EraseRow(uint16_t row)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  NVMCTRL->ADDR.reg = (STORE_BASE + row*STORE_ROW_LEN)/2;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+  while(!NVMCTRL->INTFLAG.bit.READY);
+#elif defined(ARDUINO_HOST)
+  HostFlashErase(STORE_BASE + row*STORE_ROW_LEN,STORE_ROW_LEN);
+#endif
+  Erases++;
+}
+
+uint32_t sSTORE::CRC32(const uint8_t *data, uint16_t len)
+{
+uint32_t crc;
+uint8_t b;
+
+  crc = 0xFFFFFFFF;
+  while(len--)
+  {
+    crc ^= *data++;
+    for(b=0;b<8;b++)
+      crc = crc&1 ? (crc>>1)^0xEDB88320 : crc>>1;
+  }
+  return ~crc;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*------------------------------------------------------------------------------*\
+Simple hardware-timed Sweep for ADF4351
+(c,2003 luis-es)
+
+  Points are planned ahead into ready-to-send R0-R4 words, then stepped
+  from the timer interrupt (sTIMER.h) with LoadREGS(), which only shifts
+  out the words that differ from the previous point. The main loop is
+  never involved, so dwell jitter is that of the interrupt entry.
+
+  Define this based on available memory (20 bytes per point)
+*/
+#define SWEEP_MAX       256
+#define SWEEP_DWELL_MIN 20        // us, room for 5 SPI words in the ISR
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _SSWEEP_H
+#define _SSWEEP_H
+
+#include "ADF4351.h"
+#include "sTIMER.h"
+
+class sSWEEP
+{
+	public:
+		sSWEEP();
+
+		// Plan point idx at freq (Hz). Returns 1 if it can't be synthesized
+		uint8_t Load(ADF4351 *synth, uint16_t idx, uint64_t freq);
+		// Point idx as ready-made R0-R4 words, from the host plan compiler
+		// (host/plan.cpp). Returns 1 if idx is out of range
+		uint8_t Put(uint16_t idx, const uint32_t *reg);
+		// Step through points 0..count-1 every dwell_us, over and over
+		bool Start(ADF4351 *synth, uint16_t count, uint32_t dwell_us);
+		void Stop(void);
+		bool Running(void);
+
+		// Measured points per second since Start()
+		uint32_t Rate(void);
+
+		// Timer callback: send the next point
+		void Tick(void);
+
+	private:
+		uint32_t Points[SWEEP_MAX][5];
+		ADF4351 *Synth;
+		uint16_t Count;
+		volatile uint16_t Index;
+		volatile uint32_t Steps;
+		uint32_t StartTime;
+		volatile bool Active;
+};
+
+sSWEEP *sweepInstance;
+
+void SweepTimerISR(void)
+{
+  sweepInstance->Tick();
+}
+
+
+sSWEEP::sSWEEP()
+{
+  Count = 0;
+  Index = 0;
+  Steps = 0;
+  Active = 0;
+}
+
+/* Public Functions =============================================================*/
+
+uint8_t sSWEEP::Load(ADF4351 *synth, uint16_t idx, uint64_t freq)
+{
+  if(idx>=SWEEP_MAX || Active)
+    return 1;
+
+  return synth->MakeREGS(freq, Points[idx]) ? 1 : 0;
+}
+
+uint8_t sSWEEP::Put(uint16_t idx, const uint32_t *reg)
+{
+  if(idx>=SWEEP_MAX || Active)
+    return 1;
+
+  memcpy(Points[idx],reg,sizeof(Points[idx]));
+  return 0;
+}
+
+bool sSWEEP::Start(ADF4351 *synth, uint16_t count, uint32_t dwell_us)
+{
+  if(count==0 || count>SWEEP_MAX)
+    return 0;
+  if(dwell_us<SWEEP_DWELL_MIN)
+    dwell_us=SWEEP_DWELL_MIN;
+
+  Stop();
+
+  Synth = synth;
+  Count = count;
+  Index = 0;
+  Steps = 0;
+  sweepInstance = this;
+
+  Synth->LoadREGS(Points[0]);
+  StartTime = micros();
+  Active = 1;
+  TimerStart(dwell_us, SweepTimerISR);
+  return 1;
+}
+
+void sSWEEP::Stop(void)
+{
+  if(!Active)
+    return;
+
+  TimerStop();
+  Active = 0;
+}
+
+bool sSWEEP::Running(void)
+{
+  return Active;
+}
+
+uint32_t sSWEEP::Rate(void)
+{
+uint32_t t;
+
+  t = micros() - StartTime;
+  if(!Active || t==0)
+    return 0;
+
+  return (uint64_t)Steps * 1000000 / t;
+}
+
+void sSWEEP::Tick(void)
+{
+uint16_t i;
+
+  if(!Active)
+    return;
+
+  i = Index + 1;
+  if(i>=Count)
+    i=0;
+  Index = i;
+
+  Synth->LoadREGS(Points[i]);
+  Steps++;
+}
+
+#endif
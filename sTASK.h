@@ -0,0 +1,70 @@
+/*------------------------------------------------------------------------------*\
+Simple cooperative Task scheduler
+(c,2003 luis-es)
+
+  Runs short functions from loop() every period_us microseconds, or on
+  every pass with a period of 0. Tasks must return quickly and never wait:
+  one that needs time keeps its state and checks again on its next run.
+
+  A late task runs once, not once per missed period.
+
+  Define this based on the number of tasks
+*/
+#define TASK_MAX 8
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _STASK_H
+#define _STASK_H
+
+typedef void (*task_func_t)(void);
+
+struct TaskType
+{
+  task_func_t func;
+  uint32_t period_us;
+  uint32_t next;
+};
+
+TaskType tasks[TASK_MAX];
+uint8_t taskCount = 0;
+uint32_t taskLastPass = 0;
+uint32_t taskPassMax_us = 0;   // longest time between two TaskRun(), loop() pass
+
+/* Public Functions =============================================================*/
+
+// Returns the task number, or -1 when there is no room
+int TaskAdd(task_func_t func, uint32_t period_us)
+{
+  if(taskCount>=TASK_MAX)
+    return -1;
+
+  tasks[taskCount].func = func;
+  tasks[taskCount].period_us = period_us;
+  tasks[taskCount].next = micros() + period_us;
+  return taskCount++;
+}
+
+// Call once per loop() pass
+void TaskRun(void)
+{
+uint32_t now;
+uint8_t i;
+
+  now = micros();
+  if(taskLastPass && now-taskLastPass > taskPassMax_us)
+    taskPassMax_us = now-taskLastPass;
+  taskLastPass = now;
+
+  for(i=0;i<taskCount;i++)
+  {
+    if(tasks[i].period_us && (int32_t)(now - tasks[i].next) < 0)
+      continue;
+
+    tasks[i].next += tasks[i].period_us;
+    if((int32_t)(now - tasks[i].next) >= 0)
+      tasks[i].next = now + tasks[i].period_us;    // fell behind, don't catch up
+    tasks[i].func();
+  }
+}
+
+#endif
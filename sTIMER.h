@@ -0,0 +1,88 @@
+/*------------------------------------------------------------------------------*\
+Simple periodic Timer
+(c,2003 luis-es)
+
+  Calls a function every period_us microseconds.
+
+  On AT_SAMD21 this is TC4+TC5 chained as a 32-bit counter, clocked from
+  GCLK0 (48 MHz) with no prescaler, so the callback runs from the TC4
+  interrupt with sub-microsecond resolution and up to ~89 s period.
+
+  On any other core the timer is polled: call TimerService() as often as
+  possible from loop().
+\*------------------------------------------------------------------------------*/
+#ifndef _STIMER_H
+#define _STIMER_H
+
+typedef void (*timer_func_t)(void);
+
+volatile timer_func_t timerFunc = 0;
+
+#if !defined(ARDUINO_ARCH_SAMD)
+uint32_t timerPeriod;
+uint32_t timerNext;
+#endif
+
+/* Public Functions =============================================================*/
+
+void TimerStop(void)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  TC4->COUNT32.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+  while(TC4->COUNT32.STATUS.bit.SYNCBUSY);
+  NVIC_DisableIRQ(TC4_IRQn);
+#endif
+  timerFunc = 0;
+}
+
+void TimerStart(uint32_t period_us, timer_func_t func)
+{
+  TimerStop();
+  timerFunc = func;
+
+#if defined(ARDUINO_ARCH_SAMD)
+  GCLK->CLKCTRL.reg = (uint16_t)(GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TC4_TC5);
+  while(GCLK->STATUS.bit.SYNCBUSY);
+
+  TC4->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while(TC4->COUNT32.CTRLA.bit.SWRST);
+
+  TC4->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV1;
+  TC4->COUNT32.CC[0].reg = period_us * (F_CPU/1000000) - 1;
+  while(TC4->COUNT32.STATUS.bit.SYNCBUSY);
+
+  TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+  TC4->COUNT32.INTENSET.reg = TC_INTENSET_MC0;
+  NVIC_SetPriority(TC4_IRQn, 0);
+  NVIC_EnableIRQ(TC4_IRQn);
+
+  TC4->COUNT32.CTRLA.reg |= TC_CTRLA_ENABLE;
+  while(TC4->COUNT32.STATUS.bit.SYNCBUSY);
+#else
+  timerPeriod = period_us;
+  timerNext = micros() + period_us;
+#endif
+}
+
+// Nothing to do when the timer runs from its interrupt
+void TimerService(void)
+{
+#if !defined(ARDUINO_ARCH_SAMD)
+  if(timerFunc && (int32_t)(micros() - timerNext) >= 0)
+  {
+    timerNext += timerPeriod;
+    timerFunc();
+  }
+#endif
+}
+
+#if defined(ARDUINO_ARCH_SAMD)
+void TC4_Handler(void)
+{
+  TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+  if(timerFunc)
+    timerFunc();
+}
+#endif
+
+#endif
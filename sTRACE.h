@@ -0,0 +1,135 @@
+/*------------------------------------------------------------------------------*\
+Simple binary Trace buffer
+(c,2003 luis-es)
+
+  Diagnostics as fixed size records in a RAM ring instead of text on
+  Serial. A record is an event number, the micros() it happened at and
+  two 32 bit arguments, so logging one is a handful of stores and never
+  waits on the port. When the ring is full the oldest records go.
+
+    | Time, us | Event | Seq | A | B |     16 bytes, little endian
+
+  Seq counts records, so gaps show what was lost. Every event has a level:
+  levels not in TRACE_LEVELS are compiled out, and the rest are filtered
+  at run time by traceMask (SYST:TRAC:MASK). SYST:TRAC:DATA? sends the
+  records, oldest first, as an IEEE 488.2 block (#<n><length><bytes>) and
+  empties the ring. host/trace.py turns them back into text, with the
+  formats in the comments of TraceEvent below, so keep them one per line.
+
+  Records may be put from interrupts too: a record goes in with them
+  off, a few stores. Dumping is for the main loop.
+
+  Define this based on available memory (16 bytes per record)
+*/
+#define TRACE_SIZE      128       // records, power of 2
+#define TRACE_LEVELS    0x0F      // compiled in: ERR 1, CMD 2, PLAN 4, SPI 8
+#define TRACE_MASK      0x07      // on at start, SPI is a readback per retune
+/*
+\*------------------------------------------------------------------------------*/
+#ifndef _STRACE_H
+#define _STRACE_H
+
+#define TRACE_ERR       0x01
+#define TRACE_CMD       0x02
+#define TRACE_PLAN      0x04
+#define TRACE_SPI       0x08
+
+// Events, and how host/trace.py prints them: {a} {b} unsigned, {a:d}
+// signed, {a:x} hex, {b:hi} {b:lo} 16 bit halves, {ab} a and b as one
+// 64 bit value (b high), {a:r} the register a word is for and {a:w}
+// the word field by field
+enum TraceEvent
+{
+  TR_NONE,
+  TR_BOOT,          // "start"
+  TR_SCPI_ERR,      // "error {a:d}, node {b}"
+  TR_NODE_FULL,     // "SCPI node table full"
+  TR_HASH_FULL,     // "SCPI hash table full"
+  TR_SCPI_SET,      // "node {a} value {b:d}"
+  TR_SCPI_QRY,      // "node {a} query"
+  TR_FREQ,          // "set frequency {ab} Hz"
+  TR_POWER,         // "set power {a:d} cdBm"
+  TR_RST,           // "reset"
+  TR_RECALL,        // "recalled slot {a}"
+  TR_CACHE_HIT,     // "plan cache hit {ab} Hz"
+  TR_PLAN_FAIL,     // "can't solve {ab} Hz"
+  TR_PLAN_PFD,      // "fPFD {a} Hz, RF divider 2^{b}"
+  TR_PLAN_NM,       // "INT {a}, FRAC/MOD {b:hi}/{b:lo}"
+  TR_PLAN_ERR,      // "error {a:d} mHz"
+  TR_WORD,          // "w{a:r} {a:x} {a:w}"
+  TR_READ,          // "r{a} {b:x} {b:w}"
+  TR_OPC,           // "operation complete, {a} ms"
+  TR_EVENTS
+};
+
+struct TraceRecord
+{
+  uint32_t Time;
+  uint16_t Event;
+  uint16_t Seq;
+  uint32_t A;
+  uint32_t B;
+};
+
+TraceRecord traceBuf[TRACE_SIZE];
+uint16_t traceHead = 0;         // records put, wraps
+uint16_t traceCount = 0;        // records in the ring
+uint8_t traceMask = TRACE_MASK & TRACE_LEVELS;
+
+/* Public Functions =============================================================*/
+
+// Whether events of level are wanted: constant 0 when compiled out
+inline bool TraceOn(uint8_t level)
+{
+  return (TRACE_LEVELS & level) && (traceMask & level);
+}
+
+inline void Trace(uint8_t level, uint16_t event, uint32_t a = 0, uint32_t b = 0)
+{
+TraceRecord *r;
+
+  if(!TraceOn(level))
+    return;
+
+  noInterrupts();
+  r = &traceBuf[traceHead & (TRACE_SIZE-1)];
+  r->Time = micros();
+  r->Event = event;
+  r->Seq = traceHead++;
+  r->A = a;
+  r->B = b;
+  if(traceCount<TRACE_SIZE)
+    traceCount++;
+  interrupts();
+}
+
+// 64 bit value, as {ab}
+inline void Trace64(uint8_t level, uint16_t event, uint64_t v)
+{
+  Trace(level, event, (uint32_t)v, (uint32_t)(v>>32));
+}
+
+// Send the ring as an IEEE 488.2 block and empty it. No line end
+void TraceDump(Print &out)
+{
+uint16_t i,n,head;
+char len[8];
+
+  noInterrupts();
+  n = traceCount;
+  head = traceHead;
+  interrupts();
+
+  sprintf(len,"%u",n*(unsigned)sizeof(TraceRecord));
+  out.print("#");out.print((unsigned)strlen(len));out.print(len);
+  for(i=0;i<n;i++)
+    out.write((const uint8_t *)&traceBuf[(head-n+i) & (TRACE_SIZE-1)],sizeof(TraceRecord));
+
+  // what came in meanwhile stays for next time
+  noInterrupts();
+  n = traceHead-head;
+  traceCount = n<TRACE_SIZE ? n : TRACE_SIZE;
+  interrupts();
+}
+
+#endif